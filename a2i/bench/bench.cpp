@@ -0,0 +1,306 @@
+#include <chrono>
+#include <fstream>
+#include <functional>
+#include <random>
+#include <string>
+#include <thread>
+
+#include "spectrogram.hpp"
+#include "multi_channel_spectrogram.hpp"
+
+#ifndef A2I_BENCH_BUILD_TYPE
+#define A2I_BENCH_BUILD_TYPE ""
+#endif
+
+/**
+ * Self-contained benchmark harness for the DSP and render hot paths.
+ *
+ * Every case is run until it has taken at least --min_time seconds and the
+ * mean time per iteration is reported. Output is JSON in the layout of
+ * Google Benchmark, so results of two commits can be compared with its
+ * tools/compare.py.
+ *
+ *   a2i_bench [--filter=<substring>] [--min_time=<seconds>] [--out=<file>]
+ */
+
+namespace {
+
+  struct Result
+  {
+    std::string name;
+    size_t iterations;
+    double time_ns;
+  };
+
+  struct Options
+  {
+    std::string filter;
+    std::string out;
+    double min_time = 0.2;
+  };
+
+  const std::vector<unsigned int> frame_sizes = {512, 2048, 8192, 32768, 65536};
+  const std::vector<int> widths = {400, 1000, 2100, 3840};
+  const int height = 400;
+  const unsigned int sample_rate = 44100;
+
+  std::vector<Result> results;
+  Options options;
+
+  void measure(const std::string& name, const std::function<void()>& body)
+  {
+    if(!options.filter.empty() && name.find(options.filter) == std::string::npos)
+    {
+      return;
+    }
+
+    using clock = std::chrono::steady_clock;
+
+    body();
+
+    size_t iterations = 1;
+    while(true)
+    {
+      auto start = clock::now();
+      for(size_t i = 0; i < iterations; ++i)
+      {
+        body();
+      }
+      double elapsed = std::chrono::duration<double>(clock::now() - start).count();
+
+      if(elapsed >= options.min_time || iterations >= (1u << 30))
+      {
+        results.push_back({name, iterations, elapsed * 1e9 / iterations});
+        std::cerr << name << ": " << results.back().time_ns << " ns\n";
+        return;
+      }
+
+      iterations = elapsed > 0 ? 
+        std::max(iterations * 2, static_cast<size_t>(iterations * options.min_time * 1.2 / elapsed))
+      : iterations * 10;
+    }
+  }
+
+  std::vector<float> makeSignal(size_t n)
+  {
+    std::mt19937 rng(42);
+    std::normal_distribution<float> noise(0.0f, 0.05f);
+    std::vector<float> signal(n);
+
+    for(size_t i = 0; i < n; ++i)
+    {
+      double t = static_cast<double>(i) / sample_rate;
+      signal[i] = 0.5 * std::sin(2 * M_PI * 440 * t) 
+                + 0.25 * std::sin(2 * M_PI * 3520 * t) 
+                + 0.1 * std::sin(2 * M_PI * 12000 * t) 
+                + noise(rng);
+    }
+
+    return signal;
+  }
+
+  void setup(a2i::Spectrogram& g, unsigned int frame_size, const std::vector<float>& signal)
+  {
+    g.setAudioInfo(sample_rate, {-90, 50});
+    g.setFreqRange({20, 20000});
+    g.setFrameSize(frame_size);
+    g.setWindowFunc(a2i::HANN_POISSON);
+    g.push(signal.data(), frame_size);
+    g.addWindow();
+    g.fft();
+    g.normalize();
+  }
+
+  void benchDsp(const std::vector<float>& signal)
+  {
+    for(auto frame_size : frame_sizes)
+    {
+      a2i::Spectrogram g;
+      setup(g, frame_size, signal);
+      const std::string size = std::to_string(frame_size);
+
+      for(int type = a2i::SINE; type <= a2i::HANN_POISSON; ++type)
+      {
+        measure("setWindowFunc/" + std::to_string(type) + "/" + size, [&] { g.setWindowFunc(type); });
+      }
+      g.setWindowFunc(a2i::HANN_POISSON);
+
+      measure("addWindow/" + size, [&] { g.addWindow(); });
+      measure("fft/" + size, [&] { g.fft(); });
+
+      g.setNormalizeMode(a2i::FAST);
+      measure("normalize/fast/" + size, [&] { g.normalize(); });
+      g.setNormalizeMode(a2i::EXACT);
+      measure("normalize/exact/" + size, [&] { g.normalize(); });
+
+      g.setNormalizeMode(a2i::FAST);
+      g.setFeatures(true);
+      measure("normalize/features/" + size, [&] { g.normalize(); });
+      g.setFeatures(false);
+    }
+  }
+
+  void benchMultiChannel(const std::vector<float>& signal)
+  {
+    const unsigned int channels = 8;
+
+    for(auto frame_size : frame_sizes)
+    {
+      // channel c is the test signal delayed by c * 64 samples
+      std::vector<std::vector<float>> planar(channels, std::vector<float>(frame_size));
+      std::vector<float> interleaved(static_cast<size_t>(frame_size) * channels);
+
+      for(unsigned int c = 0; c < channels; ++c)
+      {
+        for(size_t i = 0; i < frame_size; ++i)
+        {
+          planar[c][i] = signal[(i + c * 64) % signal.size()];
+          interleaved[i * channels + c] = planar[c][i];
+        }
+      }
+
+      const std::string size = std::to_string(frame_size);
+
+      for(int mode = a2i::PER_CHANNEL; mode <= a2i::SUM; ++mode)
+      {
+        a2i::MultiChannelSpectrogram mc;
+        mc.setAudioInfo(sample_rate, {-90, 50});
+        mc.setWindowFunc(a2i::HANN_POISSON);
+        mc.setFrameSize(frame_size);
+        mc.setChannels(channels, mode);
+        mc.setHopSize(frame_size);
+        mc.setQueueSize(0);
+
+        measure("multichannel/" + std::to_string(mode) + "/" + size, [&]
+        {
+          mc.push(interleaved.data(), frame_size);
+          mc.process();
+        });
+      }
+
+      // one Spectrogram per channel, what the batched plan replaces
+      std::vector<a2i::Spectrogram> separate(channels);
+      for(auto& g : separate)
+      {
+        g.setAudioInfo(sample_rate, {-90, 50});
+        g.setFrameSize(frame_size);
+        g.setWindowFunc(a2i::HANN_POISSON);
+        g.setHopSize(frame_size);
+        g.setQueueSize(0);
+      }
+
+      measure("multichannel/separate/" + size, [&]
+      {
+        for(unsigned int c = 0; c < channels; ++c)
+        {
+          separate[c].push(planar[c].data(), frame_size);
+          separate[c].process();
+        }
+      });
+    }
+  }
+
+  void benchRender(const std::vector<float>& signal)
+  {
+    for(auto frame_size : frame_sizes)
+    {
+      a2i::Spectrogram g;
+      setup(g, frame_size, signal);
+
+      for(auto width : widths)
+      {
+        cv::Mat img(height, width, CV_8UC3);
+        const std::string suffix = std::to_string(frame_size) + "/" + std::to_string(width);
+
+        for(int line_type = a2i::LINES; line_type <= a2i::BARS; ++line_type)
+        {
+          for(int fill_type = a2i::NOT_FILLED; fill_type <= a2i::GRADIENT; ++fill_type)
+          {
+            measure("drawSpectrum/" + std::to_string(line_type) + "/" + std::to_string(fill_type) + "/" + suffix, [&]
+            {
+              img.setTo(cv::Scalar(0, 0, 0));
+              g.drawSpectrum(img, line_type, a2i::LOG, fill_type, true);
+            });
+          }
+        }
+
+        if(frame_size != frame_sizes.front())
+        {
+          continue;
+        }
+
+        for(int mode = a2i::LIN; mode <= a2i::LOG; ++mode)
+        {
+          measure("drawGrid/" + std::to_string(mode) + "/" + std::to_string(width), [&]
+          {
+            img.setTo(cv::Scalar(0, 0, 0));
+            g.drawGrid(img, mode);
+          });
+        }
+      }
+    }
+  }
+
+  void writeJson(std::ostream& os)
+  {
+    os << "{\n"
+       << "  \"context\": {\n"
+       << "    \"executable\": \"a2i_bench\",\n"
+       << "    \"num_cpus\": " << std::thread::hardware_concurrency() << ",\n"
+       << "    \"library_build_type\": \"" << A2I_BENCH_BUILD_TYPE << "\"\n"
+       << "  },\n"
+       << "  \"benchmarks\": [\n";
+
+    for(size_t i = 0; i < results.size(); ++i)
+    {
+      const auto& r = results[i];
+      os << "    {\n"
+         << "      \"name\": \"" << r.name << "\",\n"
+         << "      \"run_name\": \"" << r.name << "\",\n"
+         << "      \"run_type\": \"iteration\",\n"
+         << "      \"iterations\": " << r.iterations << ",\n"
+         << "      \"real_time\": " << r.time_ns << ",\n"
+         << "      \"cpu_time\": " << r.time_ns << ",\n"
+         << "      \"time_unit\": \"ns\"\n"
+         << "    }" << (i + 1 < results.size() ? "," : "") << "\n";
+    }
+
+    os << "  ]\n"
+       << "}\n";
+  }
+}
+
+int main(int argc, char** argv)
+{
+  for(int i = 1; i < argc; ++i)
+  {
+    std::string arg = argv[i];
+
+    if(arg.rfind("--filter=", 0) == 0) options.filter = arg.substr(9);
+    else if(arg.rfind("--out=", 0) == 0) options.out = arg.substr(6);
+    else if(arg.rfind("--min_time=", 0) == 0) options.min_time = std::stod(arg.substr(11));
+    else
+    {
+      std::cerr << "Usage: a2i_bench [--filter=<substring>] [--min_time=<seconds>] [--out=<file>]\n";
+      return 1;
+    }
+  }
+
+  auto signal = makeSignal(frame_sizes.back());
+
+  benchDsp(signal);
+  benchMultiChannel(signal);
+  benchRender(signal);
+
+  if(options.out.empty())
+  {
+    writeJson(std::cout);
+  }
+  else
+  {
+    std::ofstream file(options.out);
+    writeJson(file);
+  }
+
+  return 0;
+}
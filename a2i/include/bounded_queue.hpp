@@ -0,0 +1,89 @@
+#ifndef BOUNDED_QUEUE_HPP
+#define BOUNDED_QUEUE_HPP
+
+#include <stddef.h>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+
+namespace a2i {
+
+  /**
+   * @brief Blocking FIFO with a fixed capacity.
+   *
+   * push() waits while the queue is full and pop() waits while it is empty,
+   * so a fast producer is throttled to the pace of its consumer instead of
+   * piling up items. close() wakes both sides: push() then refuses new items
+   * and pop() drains what is left before returning false.
+   */
+  template<typename T>
+  class BoundedQueue
+  {
+  public:
+    explicit BoundedQueue(size_t capacity) : queue_capacity(capacity ? capacity : 1) {};
+    ~BoundedQueue() {};
+
+    BoundedQueue(const BoundedQueue&) = delete;
+    BoundedQueue& operator=(const BoundedQueue&) = delete;
+
+    bool push(T value)
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      not_full.wait(lock, [&] { return closed || items.size() < queue_capacity; });
+
+      if(closed)
+      {
+        return false;
+      }
+
+      items.push_back(std::move(value));
+      not_empty.notify_one();
+      return true;
+    }
+
+    bool pop(T& value)
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      not_empty.wait(lock, [&] { return closed || !items.empty(); });
+
+      if(items.empty())
+      {
+        return false;
+      }
+
+      value = std::move(items.front());
+      items.pop_front();
+      not_full.notify_one();
+      return true;
+    }
+
+    void close()
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      closed = true;
+      not_full.notify_all();
+      not_empty.notify_all();
+    }
+
+    size_t size() const
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      return items.size();
+    }
+
+    size_t capacity() const
+    {
+      return queue_capacity;
+    }
+
+  private:
+    const size_t queue_capacity;
+    std::deque<T> items;
+    bool closed = false;
+    mutable std::mutex mutex;
+    std::condition_variable not_full;
+    std::condition_variable not_empty;
+  };
+};
+
+#endif // BOUNDED_QUEUE_HPP
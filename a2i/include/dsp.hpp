@@ -0,0 +1,73 @@
+#ifndef DSP_HPP
+#define DSP_HPP
+
+#include <stddef.h>
+#include <complex>
+#include <vector>
+
+/**
+ * @brief Low-level kernels used by Spectrogram.
+ *
+ * powerToDb() is selected once at runtime: AVX2 when the CPU supports it,
+ * SSE2 on other x86-64 machines and portable scalar code elsewhere. All of
+ * them use the same fast log2 (exponent plus a degree-5 polynomial on the
+ * mantissa reduced to [sqrt(2)/2, sqrt(2))), whose absolute error is below
+ * 2e-5 in log2, i.e. about 1.2e-4 dB for multiplier 20 plus the float
+ * rounding of the result. powerToDbExact() is the std::log10 reference. kernels() lists
+ * every implementation the CPU can run so each one can be checked.
+ */
+namespace a2i::dsp {
+
+  void powerToDb(
+    const std::complex<float>* in, 
+    float* out, 
+    size_t n, 
+    float scale, 
+    float multiplier, 
+    float db_min, 
+    float db_max);
+
+  void powerToDbExact(
+    const std::complex<float>* in, 
+    float* out, 
+    size_t n, 
+    float scale, 
+    float multiplier, 
+    float db_min, 
+    float db_max);
+
+  // same conversion for powers that are already summed, e.g. filterbank bands
+  void powerValuesToDb(
+    const float* in, 
+    float* out, 
+    size_t n, 
+    float scale, 
+    float multiplier, 
+    float db_min, 
+    float db_max);
+
+  void powerValuesToDbExact(
+    const float* in, 
+    float* out, 
+    size_t n, 
+    float scale, 
+    float multiplier, 
+    float db_min, 
+    float db_max);
+
+  float fastLog2(float x);
+
+  typedef void (*powerToDbFunc)(const std::complex<float>*, float*, size_t, float, float, float, float);
+
+  struct Kernel
+  {
+    powerToDbFunc func;
+    const char* name;
+  };
+
+  // in order of preference, powerToDb() runs the first one
+  std::vector<Kernel> kernels();
+  const char* kernelName();
+};
+
+#endif // DSP_HPP
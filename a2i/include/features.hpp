@@ -0,0 +1,43 @@
+#ifndef FEATURES_HPP
+#define FEATURES_HPP
+
+#include <stddef.h>
+#include <array>
+
+namespace a2i {
+
+  struct Peak
+  {
+    float frequency = 0;  // Hz, parabolic interpolation between bins
+    float db = 0;
+  };
+
+  /**
+   * @brief Per-frame spectral features, filled by Spectrogram::normalize()
+   * when enabled with setFeatures().
+   *
+   * Peak levels are in dB with the normalize() multiplier, like the
+   * spectrum they come from. rms and peak are sample amplitudes in dBFS
+   * (20 log10) whatever the multiplier. Frequencies are in Hz.
+   * flatness is the geometric over the arithmetic mean of the bin powers
+   * (0 tonal, about 0.56 for a frame of white noise, 1 only for a perfectly
+   * flat spectrum), flux the mean positive dB change per bin
+   * against the previous frame.
+   */
+  struct Features
+  {
+    static constexpr size_t max_peaks = 8;
+
+    std::array<Peak, max_peaks> peaks;  // loudest first
+    size_t peak_count = 0;
+
+    float centroid = 0;
+    float rolloff = 0;  // 85% of the power is below
+    float flatness = 0;
+    float flux = 0;
+    float rms = 0;   // dBFS of the frame samples, before windowing
+    float peak = 0;  // dBFS
+  };
+};
+
+#endif // FEATURES_HPP
@@ -0,0 +1,75 @@
+#ifndef FILTERBANK_HPP
+#define FILTERBANK_HPP
+
+#include <stddef.h>
+#include <complex>
+#include <utility>
+#include <vector>
+
+namespace a2i {
+
+  enum filterbankScales 
+  {
+    MEL = 0,
+    BARK = 1,
+    ERB = 2,
+    CQT = 3
+  };
+
+  /**
+   * @brief Sparse band matrix applied to the FFT of a frame.
+   *
+   * MEL, BARK and ERB are triangular bands with peak 1, evenly spaced on
+   * their scale between the frequency range limits, applied to the bin
+   * powers. CQT uses spectral kernels (FFT of Hann-windowed complex
+   * exponentials, centred in the frame, coefficients below 1% of the band
+   * peak dropped) with geometrically spaced centre frequencies. The kernels
+   * carry their own window, so power() must get the FFT of the unwindowed
+   * frame for CQT. Upper range limits above Nyquist are cut to it. Kernels
+   * longer than the frame are cut to the frame size, so the lowest bands
+   * lose some of their constant Q. Bands are stored CSR-style, power() costs
+   * one multiply-add per stored coefficient.
+   */
+  class Filterbank 
+  {
+  public:
+    Filterbank(
+      int scale, 
+      unsigned int bands, 
+      unsigned int frame_size, 
+      unsigned int sample_rate, 
+      std::pair<unsigned int, unsigned int> freq_range);
+    ~Filterbank() {};
+
+    bool matches(
+      int scale, 
+      unsigned int bands, 
+      unsigned int frame_size, 
+      unsigned int sample_rate, 
+      std::pair<unsigned int, unsigned int> freq_range) const;
+
+    void power(const std::complex<float>* fft_out, float* band_power) const;
+
+    int getScale() const;
+    size_t size() const;
+    size_t coefficients() const;
+    const std::vector<float>& centers() const;
+
+  private:
+    void buildTriangles();
+    void buildKernels();
+
+    int scale;
+    unsigned int frame_size;
+    unsigned int sample_rate;
+    std::pair<unsigned int, unsigned int> freq_range;
+
+    std::vector<float> center_freqs;
+    std::vector<unsigned int> offsets;
+    std::vector<unsigned int> bins;
+    std::vector<float> weights;
+    std::vector<std::complex<float>> kernels;
+  };
+};
+
+#endif // FILTERBANK_HPP
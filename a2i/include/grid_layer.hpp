@@ -0,0 +1,65 @@
+#ifndef GRID_LAYER_HPP
+#define GRID_LAYER_HPP
+
+#include <vector>
+#include <opencv2/opencv.hpp>
+
+#include "spectrogram.hpp"
+
+namespace a2i {
+
+  /**
+   * @brief drawGrid() output cached as a sparse overlay.
+   *
+   * The grid is rasterized only when the canvas size, one of its own
+   * settings or the spectrogram's sample rate and ranges change. After each
+   * rebuild the non-black pixels are collected into per-row spans, and
+   * blend() saturating-adds only those spans to the canvas.
+   */
+  class GridLayer 
+  {
+  public:
+    explicit GridLayer(const Spectrogram& spectrogram);
+    ~GridLayer() {};
+
+    void setGraphMode(int graph_mode);
+    void setText(bool enable_text);
+    void setFreqs(const std::vector<unsigned int>& freqs);
+    void setDbRisks(int number_of_db_risks);
+    void setColors(const cv::Scalar line_color, const cv::Scalar text_color);
+
+    bool update(int rows, int cols);
+    void blend(cv::Mat& img);
+
+    const cv::Mat& image() const;
+
+  private:
+    struct Span
+    {
+      int row;
+      int first;  // byte offsets in the row
+      int last;
+    };
+
+    void rebuild();
+
+    const Spectrogram& spectrogram;
+
+    int graph_mode = 1;
+    bool enable_text = true;
+    std::vector<unsigned int> freqs;
+    int number_of_db_risks = 10;
+    cv::Scalar line_color = cv::Scalar(79, 73, 80);
+    cv::Scalar text_color = cv::Scalar(51, 186, 243);
+
+    bool dirty = true;
+    unsigned int sample_rate = 0;
+    std::pair<int, int> db_range;
+    std::pair<unsigned int, unsigned int> freq_range;
+
+    cv::Mat grid;
+    std::vector<Span> spans;
+  };
+};
+
+#endif // GRID_LAYER_HPP
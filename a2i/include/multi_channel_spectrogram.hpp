@@ -0,0 +1,112 @@
+#ifndef MULTI_CHANNEL_SPECTROGRAM_HPP
+#define MULTI_CHANNEL_SPECTROGRAM_HPP
+
+#include <stddef.h>
+#include <stdint.h>
+#include <memory>
+#include <vector>
+
+#include "spectrogram.hpp"
+
+namespace a2i {
+
+  enum channelModes
+  {
+    PER_CHANNEL = 0,
+    MID_SIDE = 1,
+    SUM = 2
+  };
+
+  /**
+   * @brief Hop-based STFT of an interleaved N-channel stream.
+   *
+   * push() splits the interleaved samples into one RingBuffer per channel,
+   * process() windows every channel of a frame into one contiguous block and
+   * transforms all of them with a single batched FFTW plan. Outputs are
+   * PER_CHANNEL (one spectrum per channel), MID_SIDE (mid and side of every
+   * channel pair, an odd last channel is passed through) or SUM (one
+   * spectrum of the summed channel powers, so out-of-phase channels do not
+   * cancel like in a downmix). Spectra use the same dB scale and clamping as
+   * Spectrogram and can be drawn with a Spectrogram set up with the same
+   * frame size, sample rate and ranges.
+   */
+  class MultiChannelSpectrogram
+  {
+  public:
+    MultiChannelSpectrogram() {};
+    MultiChannelSpectrogram(const MultiChannelSpectrogram&) = delete;
+    MultiChannelSpectrogram& operator=(const MultiChannelSpectrogram&) = delete;
+    ~MultiChannelSpectrogram() {};
+
+    void setChannels(unsigned int count, int mode = PER_CHANNEL);
+    void setAudioInfo(
+      unsigned int audio_sample_rate,
+      std::pair<int, int> audio_db_range = {-90, 6});
+    void setFrameSize(int size);
+    void setPlannerFlag(unsigned int flag = FFTW_ESTIMATE);
+    void setHopSize(unsigned int size);
+    void setOverlap(float percent);
+    void setWindowFunc(int type);
+    void setNormalizeMode(int mode);
+    void setQueueSize(size_t size);
+
+    unsigned int getChannels() const;
+    int getChannelMode() const;
+    size_t outputs() const;
+    unsigned int getHopSize() const;
+    unsigned int getFrameSize() const;
+    unsigned int getSampleRate() const;
+    std::pair<int, int> getDbRange() const;
+
+    void push(const float* interleaved, size_t frames);
+    size_t process(const int multiplier = 20);
+    bool popSpectra(std::vector<Spectrum>& spectra);
+
+    std::vector<Spectrum> out;
+
+  private:
+    void allocate();
+    void addWindows(uint64_t frame_end);
+    void fft();
+    void normalize(const int multiplier);
+
+    struct FftwDeleter
+    {
+      void operator()(void* ptr) const { fftwf_free(ptr); }
+    };
+
+    static constexpr size_t min_history = 1 << 17;
+    static constexpr size_t push_block = 1024;
+
+    unsigned int channels = 0;
+    int channel_mode = PER_CHANNEL;
+
+    std::unique_ptr<RingBuffer[]> in;
+    std::vector<float> deinterleaved;
+
+    std::shared_ptr<const std::vector<float>> window_table;
+    int window_type = HANN;
+
+    fftwf_plan plan = nullptr;
+    unsigned int plan_generation = 0;
+    unsigned int planner_flag = FFTW_ESTIMATE;
+    std::unique_ptr<float[], FftwDeleter> fft_in;
+    std::unique_ptr<fftwf_complex[], FftwDeleter> fft_buf;
+    std::vector<float> power;
+
+    int normalize_mode = FAST;
+    unsigned int frame_size = 0;
+    unsigned int hop_size = 0;
+    float overlap = 0.0f;
+    uint64_t next_frame_end = 0;
+
+    std::vector<std::vector<Spectrum>> queue = std::vector<std::vector<Spectrum>>(16);
+    size_t queue_head = 0;
+    size_t queue_count = 0;
+
+    unsigned int sample_rate = 0;
+    std::pair<int, int> db_range = {-90, 6};
+  };
+};
+
+#endif // MULTI_CHANNEL_SPECTROGRAM_HPP
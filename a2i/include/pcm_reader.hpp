@@ -0,0 +1,64 @@
+#ifndef PCM_READER_HPP
+#define PCM_READER_HPP
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+namespace a2i {
+
+  enum pcmFormats
+  {
+    S16 = 0,
+    F32 = 1
+  };
+
+  /**
+   * @brief Interleaved little-endian raw PCM from stdin ("-"), a file or a
+   * named pipe, downmixed to mono by read() or kept interleaved by
+   * readInterleaved().
+   *
+   * read() takes whatever the source has available (up to the block size
+   * given to open()), so memory stays fixed whatever the stream length and a
+   * slow live feed is not held back until a whole block arrives. A frame
+   * split between two reads is carried over to the next one.
+   */
+  class PcmReader
+  {
+  public:
+    PcmReader() {};
+    ~PcmReader();
+
+    PcmReader(const PcmReader&) = delete;
+    PcmReader& operator=(const PcmReader&) = delete;
+
+    bool open(const std::string& path, const int format, const unsigned int channels, const size_t block_frames = 4096);
+    size_t read(float* mono, const int timeout_ms = -1);
+    size_t readInterleaved(float* samples, const int timeout_ms = -1);
+    void close();
+
+    bool eof() const;
+    size_t blockFrames() const;
+    unsigned int getChannels() const;
+    uint64_t frames() const;
+
+    static int parseFormat(const std::string& name);
+
+  private:
+    bool fill(const int timeout_ms);
+    size_t decode(float* dst, const int timeout_ms, const bool mono);
+
+    int fd = -1;
+    bool owns_fd = false;
+    bool end = false;
+    int format = F32;
+    unsigned int channels = 1;
+    size_t frame_bytes = 0;
+    std::vector<uint8_t> buffer;
+    size_t pending = 0;
+    uint64_t frames_read = 0;
+  };
+};
+
+#endif // PCM_READER_HPP
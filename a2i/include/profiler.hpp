@@ -0,0 +1,119 @@
+#ifndef PROFILER_HPP
+#define PROFILER_HPP
+
+#include <stdint.h>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <string>
+
+namespace a2i {
+
+  enum profileStages 
+  {
+    STAGE_WINDOW = 0,
+    STAGE_FFT = 1,
+    STAGE_NORMALIZE = 2,
+    STAGE_DRAW = 3,
+    STAGE_COMPOSITE = 4,
+    STAGE_SHOW = 5,
+    STAGE_COUNT = 6
+  };
+
+  enum profileCounters 
+  {
+    COUNTER_FRAMES = 0,    // spectra produced
+    COUNTER_DROPPED = 1,   // frames skipped because the sample history was overwritten
+    COUNTER_LATE = 2,      // spectra replaced before anyone consumed them
+    COUNTER_OVERRUNS = 3,  // times the producer overwrote unread samples
+    COUNTER_COUNT = 4
+  };
+
+  struct StageStats
+  {
+    uint64_t count = 0;
+    uint64_t total_ns = 0;
+    uint64_t max_ns = 0;
+    double mean_ns = 0;
+    uint64_t p50_ns = 0;
+    uint64_t p99_ns = 0;
+  };
+
+  /**
+   * @brief Process-wide stage timers and event counters.
+   *
+   * Every stage keeps a count, a sum, a maximum and a histogram with one
+   * bucket per power of two nanoseconds, all relaxed atomics, so any thread
+   * can record without locking. Percentiles are the upper bound of their
+   * bucket. The library and the CLI record through the A2I_PROFILE_* macros,
+   * which compile to nothing unless A2I_PROFILE is defined (CMake option
+   * A2I_PROFILE); without it every statistic stays zero.
+   */
+  class Profiler 
+  {
+  public:
+    static Profiler& instance();
+
+    void record(int stage, uint64_t ns);
+    void count(int counter, uint64_t n = 1);
+    void reset();
+
+    StageStats stage(int stage) const;
+    uint64_t counter(int counter) const;
+
+    std::string json() const;
+    std::string csvHeader() const;
+    std::string csvRow() const;
+
+    static const char* stageName(int stage);
+    static const char* counterName(int counter);
+    static bool enabled();
+
+  private:
+    Profiler() {};
+
+    static constexpr int buckets = 48;
+
+    struct Stage
+    {
+      std::atomic<uint64_t> count{0};
+      std::atomic<uint64_t> total_ns{0};
+      std::atomic<uint64_t> max_ns{0};
+      std::array<std::atomic<uint64_t>, buckets> histogram{};
+    };
+
+    std::array<Stage, STAGE_COUNT> stages;
+    std::array<std::atomic<uint64_t>, COUNTER_COUNT> counters{};
+  };
+
+  class ScopedTimer 
+  {
+  public:
+    explicit ScopedTimer(int stage) : stage(stage), start(std::chrono::steady_clock::now()) {};
+    ~ScopedTimer() 
+    {
+      auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+      Profiler::instance().record(stage, ns);
+    };
+
+    ScopedTimer(const ScopedTimer&) = delete;
+    ScopedTimer& operator=(const ScopedTimer&) = delete;
+
+  private:
+    int stage;
+    std::chrono::steady_clock::time_point start;
+  };
+};
+
+#define A2I_PROFILE_CONCAT_(a, b) a##b
+#define A2I_PROFILE_CONCAT(a, b) A2I_PROFILE_CONCAT_(a, b)
+
+#ifdef A2I_PROFILE
+#define A2I_PROFILE_SCOPE(stage) a2i::ScopedTimer A2I_PROFILE_CONCAT(a2i_profile_timer_, __LINE__)(stage)
+#define A2I_PROFILE_COUNT(counter, n) a2i::Profiler::instance().count(counter, n)
+#else
+#define A2I_PROFILE_SCOPE(stage) ((void)0)
+#define A2I_PROFILE_COUNT(counter, n) ((void)0)
+#endif
+
+#endif // PROFILER_HPP
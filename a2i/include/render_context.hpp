@@ -0,0 +1,70 @@
+#ifndef RENDER_CONTEXT_HPP
+#define RENDER_CONTEXT_HPP
+
+#include <opencv2/opencv.hpp>
+
+#include "grid_layer.hpp"
+#include "spectrogram.hpp"
+#include "trail_buffer.hpp"
+
+namespace a2i {
+
+  struct RenderStyle
+  {
+    int line_type = 0;
+    int graph_mode = 1;
+    int fill_type = 1;
+    bool border_line = false;
+    cv::Scalar line_color = cv::Scalar(255, 255, 255);
+    cv::Scalar underline_color = cv::Scalar(127, 127, 127);
+    int gradient_coefficient = 127;
+    int colormap = -1;  // -1 keeps the BGR canvas
+    cv::Scalar background = cv::Scalar(22, 16, 20);
+  };
+
+  /**
+   * @brief Owns every buffer needed to turn spectra into display frames.
+   *
+   * Canvas, spectrum layer, colormapped output and the trail are
+   * allocated once by resize(), render() clears and composes them in place,
+   * so a running render loop does no heap allocations. The grid is cached
+   * by a GridLayer and only its non-empty spans are blended. Drawing uses the
+   * bin maps of the given Spectrogram.
+   */
+  class RenderContext 
+  {
+  public:
+    RenderContext(Spectrogram& spectrogram, int rows, int cols);
+    ~RenderContext() {};
+
+    void resize(int rows, int cols);
+    void setStyle(const RenderStyle& style);
+    void setGrid(
+      const bool enabled, 
+      const cv::Scalar line_color = cv::Scalar(79, 73, 80), 
+      const cv::Scalar text_color = cv::Scalar(51, 186, 243));
+    void setTrail(int frames);
+
+    const cv::Mat& render(const Spectrum& spectrum);
+    const cv::Mat& frame() const;
+
+    static cv::Mat makePalette(int colormap);
+
+  private:
+    void applyColormap();
+
+    Spectrogram& spectrogram;
+    RenderStyle style;
+
+    bool grid_enabled = false;
+    GridLayer grid;
+
+    cv::Mat canvas;
+    cv::Mat layer;
+    cv::Mat output;
+    cv::Mat palette;
+    TrailBuffer trail;
+  };
+};
+
+#endif // RENDER_CONTEXT_HPP
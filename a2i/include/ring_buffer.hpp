@@ -0,0 +1,58 @@
+#ifndef RING_BUFFER_HPP
+#define RING_BUFFER_HPP
+
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+#include <memory>
+#include <new>
+
+namespace a2i {
+
+  /**
+   * @brief Fixed-capacity sample history for one producer and one consumer.
+   *
+   * Every sample is stored twice (at i and i + capacity), so any run of up to
+   * capacity consecutive samples is contiguous in memory and can be read with
+   * a single linear pass. The producer publishes the write position with
+   * release semantics, the consumer never writes, so push() and latest() may
+   * run on different threads as long as the capacity covers the frame being
+   * read plus the largest chunk pushed while it is read.
+   */
+  class RingBuffer 
+  {
+  public:
+    RingBuffer() {};
+    explicit RingBuffer(size_t size);
+    ~RingBuffer() {};
+
+    void resize(size_t size);
+    void clear();
+    void push(const float* data, size_t n);
+
+    const float* latest(size_t n) const;
+    const float* at(uint64_t end, size_t n) const;
+
+    uint64_t written() const;
+    size_t size() const;
+    size_t capacity() const;
+
+  private:
+    static constexpr size_t cache_line = 64;
+
+    struct AlignedDeleter
+    {
+      void operator()(float* ptr) const { ::operator delete[](ptr, std::align_val_t(cache_line)); }
+    };
+
+    void write(size_t index, const float* data, size_t n);
+
+    std::unique_ptr<float[], AlignedDeleter> buffer;
+    size_t buffer_capacity = 0;
+    size_t mask = 0;
+
+    alignas(cache_line) std::atomic<uint64_t> write_pos{0};
+  };
+};
+
+#endif // RING_BUFFER_HPP
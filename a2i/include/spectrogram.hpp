@@ -11,11 +11,17 @@
 #include <algorithm>
 #include <vector>
 #include <map>
-#include <deque>
+#include <atomic>
+#include <memory>
+#include <span>
 
 #include <opencv2/opencv.hpp>
 #include <fftw3.h>
 
+#include "features.hpp"
+#include "filterbank.hpp"
+#include "ring_buffer.hpp"
+
 /**
  * @brief This is a brief description of the function.
  *
@@ -56,11 +62,28 @@ namespace a2i {
     BARTLETT_HANN = 8,
     HANN_POISSON = 9
   };
+
+  enum binAggregations 
+  {
+    AGGREGATE_MAX = 0,
+    AGGREGATE_MEAN = 1,
+    AGGREGATE_RMS = 2
+  };
+
+  enum normalizeModes 
+  {
+    EXACT = 0,
+    FAST = 1
+  };
+
+  typedef std::vector<float> Spectrum;
   
   class Spectrogram 
   {
   public:
     Spectrogram() {};
+    Spectrogram(const Spectrogram& other);
+    Spectrogram& operator=(const Spectrogram& other) = delete;
     ~Spectrogram() {};
 
     void setAudioInfo(
@@ -72,10 +95,33 @@ namespace a2i {
       unsigned int> audio_freq_range = {0, 20000});
 
     void setFrameSize(int size);
+    void setPlannerFlag(unsigned int flag = FFTW_ESTIMATE);
+    void setHopSize(unsigned int size);
+    void setOverlap(float percent);
+    void setQueueSize(size_t size);
+    unsigned int getHopSize() const;
+    unsigned int getFrameSize() const;
+    unsigned int getSampleRate() const;
+    std::pair<int, int> getDbRange() const;
+    std::pair<unsigned int, unsigned int> getFreqRange() const;
+    int getWindowFunc() const;
     void setWindowFunc(int type);
+    void setNormalizeMode(int mode);
+    void setBinAggregation(int mode);
+    void setFilterbank(int scale, unsigned int number_of_bands = 128);
+    const Filterbank* getFilterbank() const;
+    void setFeatures(bool enabled);
+    bool getFeaturesEnabled() const;
     void addWindow();
+    void addWindow(const float* frame);
     void fft();
     void normalize(const int multiplier = 20);
+
+    void push(const float* samples, size_t n);
+    size_t process(const int multiplier = 20);
+    bool popSpectrum(Spectrum& spectrum);
+    bool popSpectrum(Spectrum& spectrum, Features& frame_features);
+
     void drawGrid(
       cv::Mat& img, 
       const int type, 
@@ -83,10 +129,21 @@ namespace a2i {
       const std::vector<unsigned int>& freqs = {}, 
       const int number_of_db_risks = 10,
       const cv::Scalar line_color = cv::Scalar(79, 73, 80), 
-      const cv::Scalar text_color = cv::Scalar(51, 186, 243));
+      const cv::Scalar text_color = cv::Scalar(51, 186, 243)) const;
+
+    void drawSpectrum(
+      cv::Mat& img, 
+      const int line_type = 0, 
+      const int graph_mode = 1, 
+      const int fill_type = 1, 
+      const bool border_line = false,
+      const cv::Scalar line_color = cv::Scalar(255, 255, 255), 
+      const cv::Scalar underline_color = cv::Scalar(127, 127, 127),
+      const int gradient_coefficient = 127);
 
     void drawSpectrum(
       cv::Mat& img, 
+      const Spectrum& spectrum,
       const int line_type = 0, 
       const int graph_mode = 1, 
       const int fill_type = 1, 
@@ -95,10 +152,41 @@ namespace a2i {
       const cv::Scalar underline_color = cv::Scalar(127, 127, 127),
       const int gradient_coefficient = 127);
 
+    void drawColumn(
+      cv::Mat& img, 
+      const int x, 
+      const Spectrum& spectrum, 
+      const int graph_mode = 1);
+
+    /**
+     * Unlike drawSpectrum() and drawColumn(), x follows the drawGrid() layout
+     * for the same graph mode and freqs, so a grid lines up with the row.
+     */
+    void drawRow(
+      cv::Mat& img, 
+      const int y, 
+      const Spectrum& spectrum, 
+      const int graph_mode = 1,
+      const std::vector<unsigned int>& freqs = {});
+
+    static bool loadWisdom(const std::string& path);
+    static bool saveWisdom(const std::string& path);
+    /**
+     * Destroys every cached plan and releases FFTW's planner state. Instances
+     * notice on their next fft() and fetch a fresh plan, but the call must not
+     * overlap process() or fft() on any other thread: stop the workers first.
+     */
+    static void clearPlans();
+    static unsigned int planGeneration();
+    static fftwf_plan getPlan(unsigned int size, unsigned int flag, unsigned int howmany = 1);
+    static std::shared_ptr<const std::vector<float>> getWindowTable(int type, unsigned int size);
+
     std::vector<float> out;
-    std::vector<std::complex<float>> fft_out;
-    std::vector<float> window_out;
-    std::deque<float> in;
+    std::vector<float> bands;
+    Features features;
+    std::span<std::complex<float>> fft_out;
+    std::span<const float> window_out;
+    RingBuffer in;
   
   private:
     double interpolate(
@@ -106,41 +194,123 @@ namespace a2i {
       double to ,
       float percent);
 
-    void drawGraientLine(
+    // drawGrid() x axis, origin is the first grid frequency
+    double gridPosition(double freq, const int type, const unsigned int origin) const;
+    double gridFreq(double position, const int type, const unsigned int origin) const;
+
+    void markColumn(cv::Mat& img, const int x, const int y);
+
+    void fillColumns(
       cv::Mat& img,
       const int fill_type, 
-      const cv::Point& first_point, 
-      const cv::Point& second_point, 
       const cv::Scalar underline_color,
-      const int gradient_color);
-
-    void windowSine();
-    void windowHann();
-    void windowHamming();
-    void windowBlackman();
-    void windowNuttall();
-    void windowBlackmanNuttall();
-    void windowBlackmanHarris();
-    void windowFlatTop();
-    void windowBartlettHann();
-    void windowHannPoisson();
-
-    using windowFuncType = void (Spectrogram::*)();
-
-    std::vector<windowFuncType> windows = {
-      &Spectrogram::windowSine,
-      &Spectrogram::windowHann,
-      &Spectrogram::windowHamming,
-      &Spectrogram::windowBlackman,
-      &Spectrogram::windowNuttall,
-      &Spectrogram::windowBlackmanNuttall,
-      &Spectrogram::windowBlackmanHarris,
-      &Spectrogram::windowFlatTop,
-      &Spectrogram::windowBartlettHann,
-      &Spectrogram::windowHannPoisson
+      const int gradient_coefficient);
+
+    // bins [first, last) that land on pixel x of an axis
+    struct BinGroup
+    {
+      int x;
+      unsigned int first;
+      unsigned int last;
+    };
+
+    struct BinMap
+    {
+      unsigned int frame_size = 0;
+      unsigned int sample_rate = 0;
+      std::pair<unsigned int, unsigned int> freq_range;
+      int length = -1;
+      int graph_mode = -1;
+      unsigned int origin = 0;  // non-zero follows the drawGrid() layout
+      std::vector<BinGroup> groups;
+    };
+
+    const BinMap& getSpectrumMap(const int width, const int graph_mode);
+    const BinMap& getPixelMap(BinMap& map, const int length, const int graph_mode, const bool bottom_up, const unsigned int origin = 0);
+    bool isValid(const BinMap& map, const int length, const int graph_mode, const unsigned int origin = 0) const;
+    double freqToPosition(double freq, const int graph_mode) const;
+    float aggregate(const Spectrum& spectrum, const BinGroup& group) const;
+    int dbToY(float db, int rows) const;
+
+    BinMap spectrum_map;
+    BinMap column_map;
+    BinMap row_map;
+    std::vector<cv::Point> control_points;
+    std::vector<cv::Point> border_points;
+    std::vector<uint16_t> column_top;
+    std::vector<uint16_t> fill_top;
+    std::vector<uchar> fill_color;
+    std::vector<uchar> gradient_lut;
+    int gradient_lut_coefficient = -1;
+    int bin_aggregation = AGGREGATE_MAX;
+
+    void updateFilterbank();
+
+    std::shared_ptr<const Filterbank> filterbank;
+    int filterbank_scale = MEL;
+    unsigned int filterbank_bands = 0;
+    std::vector<float> band_power;
+
+    using normalizeKernel = void (*)(const std::complex<float>*, float*, size_t, float, float, float, float);
+
+    void extractFeatures(normalizeKernel kernel, const int multiplier);
+    void addPeak(size_t bin);
+
+    bool features_enabled = false;
+    std::vector<float> previous_out;
+    std::vector<double> block_power;
+    float frame_rms = 0;
+    float frame_peak = 0;
+    std::atomic<int> db_multiplier{20};  // read while drawing from another thread
+
+    static void windowSine(std::vector<float>& window);
+    static void windowHann(std::vector<float>& window);
+    static void windowHamming(std::vector<float>& window);
+    static void windowBlackman(std::vector<float>& window);
+    static void windowNuttall(std::vector<float>& window);
+    static void windowBlackmanNuttall(std::vector<float>& window);
+    static void windowBlackmanHarris(std::vector<float>& window);
+    static void windowFlatTop(std::vector<float>& window);
+    static void windowBartlettHann(std::vector<float>& window);
+    static void windowHannPoisson(std::vector<float>& window);
+
+    using windowFuncType = void (*)(std::vector<float>&);
+
+    static const std::vector<windowFuncType> windows;
+
+    std::shared_ptr<const std::vector<float>> window_table;
+    int window_type = -1;
+
+    struct FftwDeleter
+    {
+      void operator()(void* ptr) const { fftwf_free(ptr); }
     };
 
-    unsigned int frame_size;
+    fftwf_plan plan = nullptr;
+    unsigned int plan_generation = 0;
+    unsigned int planner_flag = FFTW_ESTIMATE;
+    std::unique_ptr<float[], FftwDeleter> fft_in;
+    std::unique_ptr<fftwf_complex[], FftwDeleter> fft_buf;
+
+    // unwindowed copy of the frame and its FFT, only kept for CQT
+    std::unique_ptr<float[], FftwDeleter> raw_in;
+    std::unique_ptr<fftwf_complex[], FftwDeleter> raw_buf;
+    std::span<std::complex<float>> raw_out;
+
+    // covers large audio callbacks and a consumer lagging behind the producer
+    static constexpr size_t min_history = 1 << 17;
+
+    int normalize_mode = FAST;
+    unsigned int frame_size = 0;
+    unsigned int hop_size = 0;
+    float overlap = 0.0f;
+    uint64_t next_frame_end = 0;
+
+    std::vector<Spectrum> queue = std::vector<Spectrum>(16);
+    std::vector<Features> feature_queue = std::vector<Features>(16);
+    size_t queue_head = 0;
+    size_t queue_count = 0;
+
     unsigned int sample_rate;
     unsigned int sample_size;
     std::pair<int, int> db_range;
@@ -0,0 +1,103 @@
+#ifndef SPECTROGRAM_PYRAMID_HPP
+#define SPECTROGRAM_PYRAMID_HPP
+
+#include <stddef.h>
+#include <stdint.h>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "stft_file.hpp"
+
+namespace a2i {
+
+  enum poolingModes
+  {
+    POOL_MAX = 0,
+    POOL_MEAN = 1
+  };
+
+  /**
+   * @brief Builds a multi-resolution pyramid of STFT columns in one pass.
+   *
+   * Level 0 holds every appended column, level L one column per 2^L of them,
+   * max- or mean-pooled from the two columns below it. Each level is a uint8
+   * .a2is file (dir/level_NN.a2is) whose hop_size is the base hop times 2^L,
+   * created when its first column is ready. Only one pending column per
+   * level is kept in memory, so the stream may be of any length.
+   */
+  class PyramidWriter
+  {
+  public:
+    PyramidWriter() {};
+    ~PyramidWriter();
+
+    PyramidWriter(const PyramidWriter&) = delete;
+    PyramidWriter& operator=(const PyramidWriter&) = delete;
+
+    bool open(
+      const std::string& dir,
+      const StftHeader& base,
+      const int pooling = POOL_MAX,
+      const unsigned int max_levels = 16);
+
+    void append(const float* column);
+    void flush();
+    void close();
+
+    size_t levels() const;
+
+  private:
+    struct Level
+    {
+      StftWriter writer;
+      std::vector<float> pending;
+      bool has_pending = false;
+    };
+
+    void push(size_t level, const float* column);
+    bool addLevel();
+
+    std::string directory;
+    StftHeader base_header;
+    int pooling_mode = POOL_MAX;
+    unsigned int level_limit = 0;
+    std::vector<std::unique_ptr<Level>> pyramid;
+  };
+
+  /**
+   * @brief Reads a pyramid written by PyramidWriter.
+   *
+   * Levels are memory-mapped, so showing a window of columns only touches
+   * the pages of those columns at the level that matches the zoom.
+   * refresh() picks up columns and levels added by a writer that is still
+   * running. Levels whose files did not change are not remapped.
+   */
+  class PyramidReader
+  {
+  public:
+    PyramidReader() {};
+    ~PyramidReader() {};
+
+    PyramidReader(const PyramidReader&) = delete;
+    PyramidReader& operator=(const PyramidReader&) = delete;
+
+    bool open(const std::string& dir);
+    bool refresh();
+    void close();
+
+    size_t levels() const;
+    const StftHeader& header() const;
+    uint64_t columns(size_t level = 0) const;
+    size_t levelFor(double columns_per_pixel) const;
+    void column(size_t level, uint64_t index, float* dst) const;
+
+  private:
+    std::string directory;
+    std::vector<std::unique_ptr<StftReader>> pyramid;
+  };
+
+  std::string pyramidLevelPath(const std::string& dir, size_t level);
+};
+
+#endif // SPECTROGRAM_PYRAMID_HPP
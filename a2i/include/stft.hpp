@@ -0,0 +1,56 @@
+#ifndef STFT_HPP
+#define STFT_HPP
+
+#include <functional>
+#include <memory>
+#include <vector>
+
+#include "spectrogram.hpp"
+
+namespace a2i {
+
+  /**
+   * @brief Parallel STFT over a fully decoded signal.
+   *
+   * Every worker thread owns a copy of the prototype Spectrogram (own FFT
+   * buffers, shared cached plans and window tables) and pulls blocks of
+   * consecutive frames from a shared counter. Frames are independent, so
+   * the result is identical to running the prototype frame by frame.
+   *
+   * The frame callback is called from all worker threads at once and in no
+   * particular frame order, so it must be thread-safe. Writing each frame to
+   * its own slot, as run() into a vector does, needs no locking.
+   */
+  class Stft 
+  {
+  public:
+    using frameCallback = std::function<void(size_t frame, Spectrogram& worker)>;
+
+    explicit Stft(const Spectrogram& prototype, unsigned int threads = 0);
+    ~Stft() {};
+
+    size_t frames(size_t samples) const;
+    unsigned int threads() const;
+
+    void run(
+      const float* samples, 
+      size_t n, 
+      const frameCallback& callback, 
+      const int multiplier = 20);
+
+    void run(
+      const float* samples, 
+      size_t n, 
+      std::vector<float>& out, 
+      const int multiplier = 20);
+
+  private:
+    static constexpr size_t block_size = 32;
+
+    std::vector<std::unique_ptr<Spectrogram>> workers;
+    unsigned int frame_size;
+    unsigned int hop_size;
+  };
+};
+
+#endif // STFT_HPP
@@ -0,0 +1,127 @@
+#ifndef STFT_FILE_HPP
+#define STFT_FILE_HPP
+
+#include <stdio.h>
+#include <stdint.h>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "spectrogram.hpp"
+
+namespace a2i {
+
+  enum stftFormats 
+  {
+    FLOAT32 = 0,
+    UINT8 = 1,
+    UINT16 = 2
+  };
+
+  /**
+   * @brief Fixed 64-byte header of an .a2is file, followed by frame_count
+   * row-major frames of bins values in the given format. bins holds band
+   * values instead when scale is a filterbank (filterbankScales + 1).
+   *
+   * All fields and values are little-endian. Quantized formats map
+   * [db_min, db_max] linearly onto the full integer range. frame_count is
+   * rewritten by StftWriter::flush(), so a reader can follow a file that is
+   * still being written.
+   *
+   * Version 2 added scale. Version 1 files have zeros there, which reads as
+   * linear bins, so readers accept both and reject anything newer.
+   */
+  constexpr uint32_t stft_file_version = 2;
+
+  struct StftHeader
+  {
+    char magic[4] = {'A', '2', 'I', 'S'};
+    uint32_t version = stft_file_version;
+    uint32_t sample_rate = 0;
+    uint32_t frame_size = 0;
+    uint32_t hop_size = 0;
+    int32_t window = -1;
+    float db_min = 0;
+    float db_max = 0;
+    uint32_t bins = 0;
+    uint32_t format = FLOAT32;
+    uint64_t frame_count = 0;
+    uint32_t scale = 0;
+    uint8_t reserved[12] = {};
+  };
+
+  static_assert(sizeof(StftHeader) == 64, "StftHeader must stay 64 bytes");
+
+  StftHeader makeStftHeader(const Spectrogram& spectrogram, const int format = FLOAT32);
+  size_t stftValueSize(const int format);
+
+  /**
+   * @brief Writes an .a2is file. open() fails when db_max <= db_min or the
+   * header could not be written, append() and write() return false when the
+   * file is not open or the frame could not be written.
+   */
+  class StftWriter 
+  {
+  public:
+    StftWriter() {};
+    ~StftWriter();
+
+    bool open(const std::string& path, const StftHeader& header);
+    bool append(const float* frame);
+    bool write(uint64_t index, const float* frame);
+    void flush();
+    void close();
+
+    uint64_t frames() const;
+
+  private:
+    void encode(const float* frame, std::vector<uint8_t>& dst) const;
+
+    FILE* file = nullptr;
+    StftHeader header;
+    size_t frame_bytes = 0;
+    std::vector<uint8_t> buffer;
+    mutable std::mutex mutex;
+  };
+
+  /**
+   * @brief Memory-maps an .a2is file. refresh() remaps it only when its size
+   * or frame_count changed since the last map, so polling a file that is not
+   * being written costs one stat.
+   */
+  class StftReader 
+  {
+  public:
+    StftReader() {};
+    ~StftReader();
+
+    bool open(const std::string& path);
+    bool refresh();
+    void close();
+
+    const StftHeader& header() const;
+    uint64_t frames() const;
+    const void* data(uint64_t index) const;
+    void frame(uint64_t index, float* dst) const;
+
+  private:
+    bool map();
+    void unmap();
+    bool changed() const;
+
+    std::string path;
+    uintmax_t stat_size = 0;
+    StftHeader file_header;
+    const uint8_t* mapping = nullptr;
+    size_t mapping_size = 0;
+    size_t frame_bytes = 0;
+#ifdef _WIN32
+    void* file_handle = nullptr;
+    void* map_handle = nullptr;
+#else
+    int fd = -1;
+#endif
+  };
+};
+
+#endif // STFT_FILE_HPP
@@ -0,0 +1,41 @@
+#ifndef TRAIL_BUFFER_HPP
+#define TRAIL_BUFFER_HPP
+
+#include <stdint.h>
+#include <vector>
+#include <opencv2/opencv.hpp>
+
+namespace a2i {
+
+  /**
+   * @brief Fading trail of previously drawn spectrum layers.
+   *
+   * Instead of keeping the last N layers and blending each of them, the
+   * trail is a single exponentially decaying accumulator in 8.8 fixed point.
+   * The decay is chosen so that the newest previous layer is added with
+   * weight 0.3 and the N-th one with 0.3 / N, like the old harmonic weights.
+   * compose() adds the trail and the new layer to the canvas and folds the
+   * layer into the trail in the same pass.
+   */
+  class TrailBuffer 
+  {
+  public:
+    TrailBuffer() {};
+    explicit TrailBuffer(int frames);
+    ~TrailBuffer() {};
+
+    void setFrames(int frames);
+    int getFrames() const;
+
+    void clear();
+    void compose(cv::Mat& img, const cv::Mat& layer);
+
+  private:
+    std::vector<uint16_t> history;
+    int frames = 0;
+    uint32_t decay = 0;  // 0.16 fixed point
+    uint32_t gain = 0;   // 0.8 fixed point
+  };
+};
+
+#endif // TRAIL_BUFFER_HPP
@@ -0,0 +1,70 @@
+#ifndef TRIPLE_BUFFER_HPP
+#define TRIPLE_BUFFER_HPP
+
+#include <array>
+#include <atomic>
+
+namespace a2i {
+
+  /**
+   * @brief Latest-value handoff between one producer and one consumer.
+   *
+   * The producer fills back() and publish()es it, the consumer calls update()
+   * and reads front(). Both sides own one buffer each and swap it with the
+   * shared middle one through a single atomic exchange, so neither side ever
+   * blocks or sees a half-written value; values the consumer did not pick up
+   * in time are replaced by newer ones, publish() returns true when that
+   * happened.
+   */
+  template<typename T>
+  class TripleBuffer
+  {
+  public:
+    TripleBuffer() {};
+    explicit TripleBuffer(const T& value) : buffers{value, value, value} {};
+    ~TripleBuffer() {};
+
+    TripleBuffer(const TripleBuffer&) = delete;
+    TripleBuffer& operator=(const TripleBuffer&) = delete;
+
+    T& back()
+    {
+      return buffers[back_index];
+    }
+
+    bool publish()
+    {
+      unsigned int previous = middle.exchange(back_index | fresh, std::memory_order_acq_rel);
+      back_index = previous & index_mask;
+      return previous & fresh;
+    }
+
+    bool update()
+    {
+      if(!(middle.load(std::memory_order_relaxed) & fresh))
+      {
+        return false;
+      }
+
+      front_index = middle.exchange(front_index, std::memory_order_acq_rel) & index_mask;
+      return true;
+    }
+
+    const T& front() const
+    {
+      return buffers[front_index];
+    }
+
+  private:
+    static constexpr unsigned int index_mask = 3;
+    static constexpr unsigned int fresh = 4;
+
+    std::array<T, 3> buffers;
+    unsigned int back_index = 0;
+    unsigned int front_index = 1;
+
+    alignas(64) std::atomic<unsigned int> middle{2};
+  };
+};
+
+#endif // TRIPLE_BUFFER_HPP
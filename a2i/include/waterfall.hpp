@@ -0,0 +1,58 @@
+#ifndef WATERFALL_HPP
+#define WATERFALL_HPP
+
+#include <opencv2/opencv.hpp>
+
+#include "grid_layer.hpp"
+#include "spectrogram.hpp"
+
+namespace a2i {
+
+  /**
+   * @brief Time-scrolling heatmap of the last spectra.
+   *
+   * History is a circular single-channel image. Its colored copy is twice
+   * as tall and every row is written at head and head + rows, like the
+   * mirrored RingBuffer, so push() costs one row of drawing and colormapping
+   * and render() returns the rows [head, head + rows) as a view without
+   * copying. The returned image aliases the history and changes on the next
+   * push(). Rows follow the drawGrid() x layout, and with setGrid() the
+   * frequency lines of a GridLayer are baked into each colored row.
+   */
+  class Waterfall 
+  {
+  public:
+    Waterfall(Spectrogram& spectrogram, int rows, int cols);
+    ~Waterfall() {};
+
+    void resize(int rows, int cols);
+    void clear();
+    void setGraphMode(int graph_mode);
+    void setColormap(int colormap);
+    void setGrid(const bool enabled, const cv::Scalar line_color = cv::Scalar(79, 73, 80));
+
+    void push(const Spectrum& spectrum);
+    const cv::Mat& render();
+
+  private:
+    void colorRow(int y);
+    void recolor();
+
+    Spectrogram& spectrogram;
+    int graph_mode = 1;
+
+    // the ring fills upwards, so newest-first is [head, head + rows) of colored
+    cv::Mat history;
+    cv::Mat colored;
+    int head = 0;  // row of the newest spectrum
+
+    // one row of frequency lines, blended into every colored row
+    bool grid_enabled = false;
+    GridLayer axis;
+
+    cv::Mat palette;
+    cv::Mat output;
+  };
+};
+
+#endif // WATERFALL_HPP
@@ -0,0 +1,24 @@
+#ifndef WAV_FILE_HPP
+#define WAV_FILE_HPP
+
+#include <string>
+#include <vector>
+
+namespace a2i {
+
+  /**
+   * @brief Reads a RIFF/WAVE file into interleaved float samples in [-1, 1].
+   *
+   * 8, 16, 24 and 32-bit integer PCM and 32 and 64-bit float data are
+   * accepted, plain or as WAVE_FORMAT_EXTENSIBLE. Compressed formats return
+   * false. A data chunk longer than the file, as written by streaming
+   * encoders that never patch the size, is cut to the whole frames present.
+   */
+  bool loadWav(
+    const std::string& path, 
+    std::vector<float>& interleaved, 
+    unsigned int& sample_rate, 
+    unsigned int& channels);
+};
+
+#endif // WAV_FILE_HPP
@@ -0,0 +1,313 @@
+#include "dsp.hpp"
+
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define A2I_DSP_X86 1
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#define A2I_TARGET_AVX2
+#else
+#define A2I_TARGET_AVX2 __attribute__((target("avx2,fma")))
+#endif
+#endif
+
+namespace
+{
+  // log2(1 + t) ~ t * P(t) for t in [sqrt(2)/2 - 1, sqrt(2) - 1]
+  constexpr float c1 = 1.4425780773162842f;
+  constexpr float c2 = -0.720241904258728f;
+  constexpr float c3 = 0.48668575286865234f;
+  constexpr float c4 = -0.3945733606815338f;
+  constexpr float c5 = 0.25266000628471375f;
+
+  constexpr float log10_2 = 0.30102999566398120f;
+  constexpr float epsilon = 1e-10f;
+
+  inline float clampDb(float db, float db_min, float db_max)
+  {
+    // values out of range are pushed just outside the visible range
+    db = db < db_min ? db_min + 1 : db;
+    db = db > db_max ? db_min - 1 : db;
+    return db;
+  }
+
+  void powerToDbScalar(
+    const std::complex<float>* in, 
+    float* out, 
+    size_t n, 
+    float scale, 
+    float multiplier, 
+    float db_min, 
+    float db_max)
+  {
+    const float k = multiplier * log10_2;
+
+    for(size_t i = 0; i < n; ++i)
+    {
+      float power = std::norm(in[i]) * scale + epsilon;
+      out[i] = clampDb(k * a2i::dsp::fastLog2(power), db_min, db_max);
+    }
+  }
+
+#ifdef A2I_DSP_X86
+  inline __m128 log2Sse(__m128 x)
+  {
+    const __m128i bits = _mm_castps_si128(x);
+    __m128i exponent = _mm_sub_epi32(_mm_srli_epi32(bits, 23), _mm_set1_epi32(127));
+    __m128 mantissa = _mm_castsi128_ps(_mm_or_si128(
+      _mm_and_si128(bits, _mm_set1_epi32(0x007fffff)), _mm_set1_epi32(0x3f800000)));
+
+    const __m128 above = _mm_cmpgt_ps(mantissa, _mm_set1_ps(1.41421356f));
+    mantissa = _mm_or_ps(_mm_and_ps(above, _mm_mul_ps(mantissa, _mm_set1_ps(0.5f))), _mm_andnot_ps(above, mantissa));
+    exponent = _mm_sub_epi32(exponent, _mm_castps_si128(above));
+
+    const __m128 t = _mm_sub_ps(mantissa, _mm_set1_ps(1.0f));
+    __m128 p = _mm_set1_ps(c5);
+    p = _mm_add_ps(_mm_mul_ps(p, t), _mm_set1_ps(c4));
+    p = _mm_add_ps(_mm_mul_ps(p, t), _mm_set1_ps(c3));
+    p = _mm_add_ps(_mm_mul_ps(p, t), _mm_set1_ps(c2));
+    p = _mm_add_ps(_mm_mul_ps(p, t), _mm_set1_ps(c1));
+
+    return _mm_add_ps(_mm_cvtepi32_ps(exponent), _mm_mul_ps(p, t));
+  }
+
+  void powerToDbSse(
+    const std::complex<float>* in, 
+    float* out, 
+    size_t n, 
+    float scale, 
+    float multiplier, 
+    float db_min, 
+    float db_max)
+  {
+    const float* src = reinterpret_cast<const float*>(in);
+    const __m128 k = _mm_set1_ps(multiplier * log10_2);
+    const __m128 vscale = _mm_set1_ps(scale);
+    const __m128 veps = _mm_set1_ps(epsilon);
+    const __m128 vmin = _mm_set1_ps(db_min);
+    const __m128 vmax = _mm_set1_ps(db_max);
+    const __m128 below_value = _mm_set1_ps(db_min + 1);
+    const __m128 above_value = _mm_set1_ps(db_min - 1);
+
+    size_t i = 0;
+    for(; i + 4 <= n; i += 4)
+    {
+      __m128 a = _mm_loadu_ps(src + 2 * i);
+      __m128 b = _mm_loadu_ps(src + 2 * i + 4);
+      a = _mm_mul_ps(a, a);
+      b = _mm_mul_ps(b, b);
+
+      __m128 power = _mm_add_ps(
+        _mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0)), 
+        _mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1)));
+      power = _mm_add_ps(_mm_mul_ps(power, vscale), veps);
+
+      __m128 db = _mm_mul_ps(k, log2Sse(power));
+
+      __m128 mask = _mm_cmplt_ps(db, vmin);
+      db = _mm_or_ps(_mm_and_ps(mask, below_value), _mm_andnot_ps(mask, db));
+      mask = _mm_cmpgt_ps(db, vmax);
+      db = _mm_or_ps(_mm_and_ps(mask, above_value), _mm_andnot_ps(mask, db));
+
+      _mm_storeu_ps(out + i, db);
+    }
+
+    powerToDbScalar(in + i, out + i, n - i, scale, multiplier, db_min, db_max);
+  }
+
+  A2I_TARGET_AVX2 inline __m256 log2Avx2(__m256 x)
+  {
+    const __m256i bits = _mm256_castps_si256(x);
+    __m256i exponent = _mm256_sub_epi32(_mm256_srli_epi32(bits, 23), _mm256_set1_epi32(127));
+    __m256 mantissa = _mm256_castsi256_ps(_mm256_or_si256(
+      _mm256_and_si256(bits, _mm256_set1_epi32(0x007fffff)), _mm256_set1_epi32(0x3f800000)));
+
+    const __m256 above = _mm256_cmp_ps(mantissa, _mm256_set1_ps(1.41421356f), _CMP_GT_OQ);
+    mantissa = _mm256_blendv_ps(mantissa, _mm256_mul_ps(mantissa, _mm256_set1_ps(0.5f)), above);
+    exponent = _mm256_sub_epi32(exponent, _mm256_castps_si256(above));
+
+    const __m256 t = _mm256_sub_ps(mantissa, _mm256_set1_ps(1.0f));
+    __m256 p = _mm256_set1_ps(c5);
+    p = _mm256_fmadd_ps(p, t, _mm256_set1_ps(c4));
+    p = _mm256_fmadd_ps(p, t, _mm256_set1_ps(c3));
+    p = _mm256_fmadd_ps(p, t, _mm256_set1_ps(c2));
+    p = _mm256_fmadd_ps(p, t, _mm256_set1_ps(c1));
+
+    return _mm256_fmadd_ps(p, t, _mm256_cvtepi32_ps(exponent));
+  }
+
+  A2I_TARGET_AVX2 void powerToDbAvx2(
+    const std::complex<float>* in, 
+    float* out, 
+    size_t n, 
+    float scale, 
+    float multiplier, 
+    float db_min, 
+    float db_max)
+  {
+    const float* src = reinterpret_cast<const float*>(in);
+    const __m256 k = _mm256_set1_ps(multiplier * log10_2);
+    const __m256 vscale = _mm256_set1_ps(scale);
+    const __m256 veps = _mm256_set1_ps(epsilon);
+    const __m256 vmin = _mm256_set1_ps(db_min);
+    const __m256 vmax = _mm256_set1_ps(db_max);
+    const __m256 below_value = _mm256_set1_ps(db_min + 1);
+    const __m256 above_value = _mm256_set1_ps(db_min - 1);
+
+    size_t i = 0;
+    for(; i + 8 <= n; i += 8)
+    {
+      __m256 a = _mm256_loadu_ps(src + 2 * i);
+      __m256 b = _mm256_loadu_ps(src + 2 * i + 8);
+      a = _mm256_mul_ps(a, a);
+      b = _mm256_mul_ps(b, b);
+
+      // hadd works per 128-bit lane: p0 p1 p4 p5 | p2 p3 p6 p7
+      __m256 power = _mm256_hadd_ps(a, b);
+      power = _mm256_castpd_ps(_mm256_permute4x64_pd(_mm256_castps_pd(power), _MM_SHUFFLE(3, 1, 2, 0)));
+      power = _mm256_fmadd_ps(power, vscale, veps);
+
+      __m256 db = _mm256_mul_ps(k, log2Avx2(power));
+      db = _mm256_blendv_ps(db, below_value, _mm256_cmp_ps(db, vmin, _CMP_LT_OQ));
+      db = _mm256_blendv_ps(db, above_value, _mm256_cmp_ps(db, vmax, _CMP_GT_OQ));
+
+      _mm256_storeu_ps(out + i, db);
+    }
+
+    powerToDbScalar(in + i, out + i, n - i, scale, multiplier, db_min, db_max);
+  }
+
+  bool hasAvx2()
+  {
+#if defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 0);
+    if(info[0] < 7) return false;
+
+    __cpuid(info, 1);
+    const bool osxsave = (info[2] & (1 << 27)) != 0;
+    const bool fma = (info[2] & (1 << 12)) != 0;
+    if(!osxsave || !fma || (_xgetbv(0) & 0x6) != 0x6) return false;
+
+    __cpuidex(info, 7, 0);
+    return (info[1] & (1 << 5)) != 0;
+#else
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+#endif
+  }
+#endif
+
+  const a2i::dsp::Kernel kernel = a2i::dsp::kernels().front();
+}
+
+std::vector<a2i::dsp::Kernel> a2i::dsp::kernels()
+{
+  std::vector<Kernel> available;
+
+#ifdef A2I_DSP_X86
+  if(hasAvx2())
+  {
+    available.push_back({powerToDbAvx2, "avx2"});
+  }
+
+  available.push_back({powerToDbSse, "sse2"});
+#endif
+  available.push_back({powerToDbScalar, "scalar"});
+
+  return available;
+}
+
+float a2i::dsp::fastLog2(float x)
+{
+  uint32_t bits;
+  memcpy(&bits, &x, sizeof(bits));
+
+  int exponent = static_cast<int>((bits >> 23) & 0xff) - 127;
+  bits = (bits & 0x007fffff) | 0x3f800000;
+
+  float mantissa;
+  memcpy(&mantissa, &bits, sizeof(mantissa));
+
+  if(mantissa > 1.41421356f)
+  {
+    mantissa *= 0.5f;
+    ++exponent;
+  }
+
+  const float t = mantissa - 1.0f;
+  return exponent + t * (c1 + t * (c2 + t * (c3 + t * (c4 + t * c5))));
+}
+
+void a2i::dsp::powerToDb(
+  const std::complex<float>* in, 
+  float* out, 
+  size_t n, 
+  float scale, 
+  float multiplier, 
+  float db_min, 
+  float db_max)
+{
+  kernel.func(in, out, n, scale, multiplier, db_min, db_max);
+}
+
+void a2i::dsp::powerToDbExact(
+  const std::complex<float>* in, 
+  float* out, 
+  size_t n, 
+  float scale, 
+  float multiplier, 
+  float db_min, 
+  float db_max)
+{
+  for(size_t i = 0; i < n; ++i)
+  {
+    float db_value = multiplier * std::log10(std::norm(in[i]) * scale + epsilon);
+
+    if (db_value < db_min) db_value = db_min + 1;
+    if (db_value > db_max) db_value = db_min - 1;
+
+    out[i] = db_value;
+  }
+}
+
+void a2i::dsp::powerValuesToDb(
+  const float* in, 
+  float* out, 
+  size_t n, 
+  float scale, 
+  float multiplier, 
+  float db_min, 
+  float db_max)
+{
+  const float k = multiplier * log10_2;
+
+  for(size_t i = 0; i < n; ++i)
+  {
+    out[i] = clampDb(k * fastLog2(in[i] * scale + epsilon), db_min, db_max);
+  }
+}
+
+void a2i::dsp::powerValuesToDbExact(
+  const float* in, 
+  float* out, 
+  size_t n, 
+  float scale, 
+  float multiplier, 
+  float db_min, 
+  float db_max)
+{
+  for(size_t i = 0; i < n; ++i)
+  {
+    out[i] = clampDb(multiplier * std::log10(in[i] * scale + epsilon), db_min, db_max);
+  }
+}
+
+const char* a2i::dsp::kernelName()
+{
+  return kernel.name;
+}
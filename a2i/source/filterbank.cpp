@@ -0,0 +1,215 @@
+#include "filterbank.hpp"
+
+#include <fftw3.h>
+#include <algorithm>
+#include <math.h>
+
+
+namespace
+{
+  double toScale(int scale, double freq)
+  {
+    switch(scale)
+    {
+      case a2i::BARK :
+        return 26.81 * freq / (1960.0 + freq) - 0.53;
+      case a2i::ERB :
+        return 21.4 * std::log10(1.0 + 0.00437 * freq);
+      default :
+        return 2595.0 * std::log10(1.0 + freq / 700.0);
+    }
+  }
+
+  double fromScale(int scale, double value)
+  {
+    switch(scale)
+    {
+      case a2i::BARK :
+        return 1960.0 * (value + 0.53) / (26.28 - value);
+      case a2i::ERB :
+        return (std::pow(10.0, value / 21.4) - 1.0) / 0.00437;
+      default :
+        return 700.0 * (std::pow(10.0, value / 2595.0) - 1.0);
+    }
+  }
+}
+
+a2i::Filterbank::Filterbank(
+  int scale, 
+  unsigned int bands, 
+  unsigned int frame_size, 
+  unsigned int sample_rate, 
+  std::pair<unsigned int, unsigned int> freq_range) : 
+  scale(scale),
+  frame_size(frame_size),
+  sample_rate(sample_rate),
+  freq_range(freq_range),
+  center_freqs(bands)
+{
+  offsets.reserve(bands + 1);
+  offsets.push_back(0);
+
+  if(scale == CQT) buildKernels();
+  else buildTriangles();
+}
+
+bool a2i::Filterbank::matches(
+  int other_scale, 
+  unsigned int bands, 
+  unsigned int other_frame_size, 
+  unsigned int other_sample_rate, 
+  std::pair<unsigned int, unsigned int> other_freq_range) const
+{
+  return scale == other_scale 
+    && size() == bands 
+    && frame_size == other_frame_size 
+    && sample_rate == other_sample_rate 
+    && freq_range == other_freq_range;
+}
+
+void a2i::Filterbank::buildTriangles()
+{
+  const size_t bands = center_freqs.size();
+  const unsigned int last_bin = frame_size / 2 - 1;
+  const double hz_per_bin = static_cast<double>(sample_rate) / frame_size;
+
+  const double first = toScale(scale, std::max(1u, freq_range.first));
+  const double step = (toScale(scale, std::min(freq_range.second, sample_rate / 2)) - first) / (bands + 1);
+
+  for(size_t b = 0; b < bands; ++b)
+  {
+    const double left = fromScale(scale, first + b * step);
+    const double center = fromScale(scale, first + (b + 1) * step);
+    const double right = fromScale(scale, first + (b + 2) * step);
+    center_freqs[b] = center;
+
+    unsigned int from = std::min(static_cast<unsigned int>(std::ceil(left / hz_per_bin)), last_bin);
+    unsigned int to = std::min(static_cast<unsigned int>(right / hz_per_bin), last_bin);
+
+    for(unsigned int bin = from; bin <= to; ++bin)
+    {
+      const double freq = bin * hz_per_bin;
+      const double weight = freq <= center ? (freq - left) / (center - left) : (right - freq) / (right - center);
+
+      if(weight > 0)
+      {
+        bins.push_back(bin);
+        weights.push_back(weight);
+      }
+    }
+
+    // bands narrower than a bin still take the nearest one
+    if(bins.size() == offsets.back())
+    {
+      bins.push_back(std::min(static_cast<unsigned int>(std::lround(center / hz_per_bin)), last_bin));
+      weights.push_back(1.0f);
+    }
+
+    offsets.push_back(bins.size());
+  }
+}
+
+void a2i::Filterbank::buildKernels()
+{
+  const size_t bands = center_freqs.size();
+  const double fmin = std::max(1u, freq_range.first);
+  const double octaves = std::log2(static_cast<double>(std::min(freq_range.second, sample_rate / 2)) / fmin);
+  const double bins_per_octave = bands / std::max(octaves, 1e-3);
+  const double q = 1.0 / (std::exp2(1.0 / bins_per_octave) - 1.0);
+
+  fftwf_complex* temporal = fftwf_alloc_complex(frame_size);
+  fftwf_complex* spectral = fftwf_alloc_complex(frame_size);
+  fftwf_plan plan = fftwf_plan_dft_1d(frame_size, temporal, spectral, FFTW_FORWARD, FFTW_ESTIMATE);
+
+  for(size_t b = 0; b < bands; ++b)
+  {
+    const double freq = fmin * std::exp2(b / bins_per_octave);
+    center_freqs[b] = freq;
+
+    const unsigned int length = std::clamp<unsigned int>(std::ceil(q * sample_rate / freq), 1, frame_size);
+    const unsigned int start = (frame_size - length) / 2;
+    const double cycles = freq * length / sample_rate;
+
+    std::fill(temporal[0], temporal[0] + 2 * frame_size, 0.0f);
+    for(unsigned int n = 0; n < length; ++n)
+    {
+      const double window = (0.5 - 0.5 * std::cos(2 * M_PI * (n + 0.5) / length)) / length;
+      temporal[start + n][0] = window * std::cos(2 * M_PI * cycles * n / length);
+      temporal[start + n][1] = window * std::sin(2 * M_PI * cycles * n / length);
+    }
+
+    fftwf_execute(plan);
+
+    // the input is real, so only the positive half of the kernel is used
+    float peak = 0;
+    for(unsigned int k = 0; k < frame_size / 2; ++k)
+    {
+      peak = std::max(peak, std::hypot(spectral[k][0], spectral[k][1]));
+    }
+
+    for(unsigned int k = 0; k < frame_size / 2; ++k)
+    {
+      if(std::hypot(spectral[k][0], spectral[k][1]) >= 0.01f * peak)
+      {
+        bins.push_back(k);
+        kernels.push_back(std::conj(std::complex<float>(spectral[k][0], spectral[k][1])));
+      }
+    }
+
+    offsets.push_back(bins.size());
+  }
+
+  fftwf_destroy_plan(plan);
+  fftwf_free(temporal);
+  fftwf_free(spectral);
+}
+
+void a2i::Filterbank::power(const std::complex<float>* fft_out, float* band_power) const
+{
+  const size_t bands = center_freqs.size();
+
+  if(scale == CQT)
+  {
+    for(size_t b = 0; b < bands; ++b)
+    {
+      std::complex<float> sum = 0;
+      for(unsigned int i = offsets[b]; i < offsets[b + 1]; ++i)
+      {
+        sum += fft_out[bins[i]] * kernels[i];
+      }
+      band_power[b] = std::norm(sum);
+    }
+
+    return;
+  }
+
+  for(size_t b = 0; b < bands; ++b)
+  {
+    float sum = 0;
+    for(unsigned int i = offsets[b]; i < offsets[b + 1]; ++i)
+    {
+      sum += std::norm(fft_out[bins[i]]) * weights[i];
+    }
+    band_power[b] = sum;
+  }
+}
+
+int a2i::Filterbank::getScale() const
+{
+  return scale;
+}
+
+size_t a2i::Filterbank::size() const
+{
+  return center_freqs.size();
+}
+
+size_t a2i::Filterbank::coefficients() const
+{
+  return bins.size();
+}
+
+const std::vector<float>& a2i::Filterbank::centers() const
+{
+  return center_freqs;
+}
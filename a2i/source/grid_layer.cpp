@@ -0,0 +1,110 @@
+#include "grid_layer.hpp"
+
+#include <algorithm>
+
+
+a2i::GridLayer::GridLayer(const Spectrogram& spectrogram) : 
+  spectrogram(spectrogram)
+{
+}
+
+void a2i::GridLayer::setGraphMode(int mode)
+{
+  dirty |= mode != graph_mode;
+  graph_mode = mode;
+}
+
+void a2i::GridLayer::setText(bool enable)
+{
+  dirty |= enable != enable_text;
+  enable_text = enable;
+}
+
+void a2i::GridLayer::setFreqs(const std::vector<unsigned int>& new_freqs)
+{
+  dirty |= new_freqs != freqs;
+  freqs = new_freqs;
+}
+
+void a2i::GridLayer::setDbRisks(int number)
+{
+  dirty |= number != number_of_db_risks;
+  number_of_db_risks = number;
+}
+
+void a2i::GridLayer::setColors(const cv::Scalar new_line_color, const cv::Scalar new_text_color)
+{
+  dirty |= new_line_color != line_color || new_text_color != text_color;
+  line_color = new_line_color;
+  text_color = new_text_color;
+}
+
+bool a2i::GridLayer::update(int rows, int cols)
+{
+  if(!dirty 
+    && grid.rows == rows 
+    && grid.cols == cols
+    && sample_rate == spectrogram.getSampleRate()
+    && db_range == spectrogram.getDbRange()
+    && freq_range == spectrogram.getFreqRange())
+  {
+    return false;
+  }
+
+  sample_rate = spectrogram.getSampleRate();
+  db_range = spectrogram.getDbRange();
+  freq_range = spectrogram.getFreqRange();
+
+  grid = cv::Mat::zeros(rows, cols, CV_8UC3);
+  rebuild();
+
+  dirty = false;
+  return true;
+}
+
+void a2i::GridLayer::rebuild()
+{
+  spectrogram.drawGrid(grid, graph_mode, enable_text, freqs, number_of_db_risks, line_color, text_color);
+
+  spans.clear();
+  const int width = grid.cols * grid.channels();
+
+  for(int y = 0; y < grid.rows; ++y)
+  {
+    const uchar* row = grid.ptr<uchar>(y);
+
+    for(int i = 0; i < width;)
+    {
+      if(!row[i])
+      {
+        ++i;
+        continue;
+      }
+
+      int first = i;
+      while(i < width && row[i]) ++i;
+      spans.push_back({y, first, i});
+    }
+  }
+}
+
+void a2i::GridLayer::blend(cv::Mat& img)
+{
+  update(img.rows, img.cols);
+
+  for(const auto& span : spans)
+  {
+    const uchar* __restrict src = grid.ptr<uchar>(span.row);
+    uchar* __restrict dst = img.ptr<uchar>(span.row);
+
+    for(int i = span.first; i < span.last; ++i)
+    {
+      dst[i] = static_cast<uchar>(std::min(dst[i] + src[i], 255));
+    }
+  }
+}
+
+const cv::Mat& a2i::GridLayer::image() const
+{
+  return grid;
+}
@@ -0,0 +1,303 @@
+#include "multi_channel_spectrogram.hpp"
+#include "dsp.hpp"
+#include "profiler.hpp"
+
+void a2i::MultiChannelSpectrogram::setChannels(unsigned int count, int mode)
+{
+  channels = count;
+  channel_mode = mode;
+  allocate();
+}
+
+void a2i::MultiChannelSpectrogram::setAudioInfo(
+  unsigned int audio_sample_rate,
+  std::pair<int, int> audio_db_range)
+{
+  sample_rate = audio_sample_rate;
+  db_range = audio_db_range;
+}
+
+void a2i::MultiChannelSpectrogram::setFrameSize(int size)
+{
+  frame_size = size;
+  allocate();
+}
+
+void a2i::MultiChannelSpectrogram::setPlannerFlag(unsigned int flag)
+{
+  planner_flag = flag;
+
+  if(frame_size && channels)
+  {
+    plan_generation = Spectrogram::planGeneration();
+    plan = Spectrogram::getPlan(frame_size, planner_flag, channels);
+  }
+}
+
+void a2i::MultiChannelSpectrogram::setHopSize(unsigned int size)
+{
+  hop_size = size;
+}
+
+void a2i::MultiChannelSpectrogram::setOverlap(float percent)
+{
+  overlap = std::clamp(percent, 0.0f, 99.0f);
+  hop_size = 0;
+}
+
+void a2i::MultiChannelSpectrogram::setWindowFunc(int type)
+{
+  window_type = type;
+
+  if(frame_size)
+  {
+    window_table = Spectrogram::getWindowTable(window_type, frame_size);
+  }
+}
+
+void a2i::MultiChannelSpectrogram::setNormalizeMode(int mode)
+{
+  normalize_mode = mode;
+}
+
+void a2i::MultiChannelSpectrogram::setQueueSize(size_t size)
+{
+  queue.assign(size, std::vector<Spectrum>());
+  queue_head = 0;
+  queue_count = 0;
+}
+
+unsigned int a2i::MultiChannelSpectrogram::getChannels() const
+{
+  return channels;
+}
+
+int a2i::MultiChannelSpectrogram::getChannelMode() const
+{
+  return channel_mode;
+}
+
+size_t a2i::MultiChannelSpectrogram::outputs() const
+{
+  return channel_mode == SUM ? std::min(channels, 1u) : channels;
+}
+
+unsigned int a2i::MultiChannelSpectrogram::getHopSize() const
+{
+  if(hop_size)
+  {
+    return hop_size;
+  }
+
+  return std::max(1u, static_cast<unsigned int>(frame_size * (1.0f - overlap / 100.0f)));
+}
+
+unsigned int a2i::MultiChannelSpectrogram::getFrameSize() const
+{
+  return frame_size;
+}
+
+unsigned int a2i::MultiChannelSpectrogram::getSampleRate() const
+{
+  return sample_rate;
+}
+
+std::pair<int, int> a2i::MultiChannelSpectrogram::getDbRange() const
+{
+  return db_range;
+}
+
+void a2i::MultiChannelSpectrogram::allocate()
+{
+  if(!frame_size || !channels)
+  {
+    return;
+  }
+
+  in = std::make_unique<RingBuffer[]>(channels);
+  for(unsigned int c = 0; c < channels; ++c)
+  {
+    in[c].resize(std::max<size_t>(frame_size * 4, min_history));
+  }
+  deinterleaved.resize(push_block);
+
+  // channel c occupies [c * frame_size, (c + 1) * frame_size) of the input
+  // and [c * (frame_size / 2 + 1), (c + 1) * (frame_size / 2 + 1)) of the output
+  fft_in.reset(fftwf_alloc_real(static_cast<size_t>(frame_size) * channels));
+  fft_buf.reset(fftwf_alloc_complex(static_cast<size_t>(frame_size / 2 + 1) * channels));
+  std::fill_n(fft_in.get(), static_cast<size_t>(frame_size) * channels, 0.0f);
+
+  plan_generation = Spectrogram::planGeneration();
+  plan = Spectrogram::getPlan(frame_size, planner_flag, channels);
+  window_table = Spectrogram::getWindowTable(window_type, frame_size);
+
+  out.assign(outputs(), Spectrum(frame_size / 2));
+  power.resize(frame_size / 2);
+
+  next_frame_end = frame_size;
+  queue_head = 0;
+  queue_count = 0;
+}
+
+void a2i::MultiChannelSpectrogram::push(const float* interleaved, size_t frames)
+{
+  // the last channel is written last, so its position bounds all the others
+  for(size_t start = 0; start < frames; start += push_block)
+  {
+    size_t n = std::min(push_block, frames - start);
+    const float* src = interleaved + start * channels;
+
+    for(unsigned int c = 0; c < channels; ++c)
+    {
+      for(size_t i = 0; i < n; ++i)
+      {
+        deinterleaved[i] = src[i * channels + c];
+      }
+
+      in[c].push(deinterleaved.data(), n);
+    }
+  }
+}
+
+size_t a2i::MultiChannelSpectrogram::process(const int multiplier)
+{
+  if(!channels || !frame_size)
+  {
+    return 0;
+  }
+
+  const uint64_t end = in[channels - 1].written();
+  const unsigned int hop = getHopSize();
+  const size_t capacity = in[channels - 1].capacity();
+  size_t produced = 0;
+
+  if(end > next_frame_end && end - next_frame_end > capacity - frame_size)
+  {
+    uint64_t lag = end - next_frame_end - (capacity - frame_size);
+    next_frame_end += (lag + hop - 1) / hop * hop;
+
+    A2I_PROFILE_COUNT(COUNTER_OVERRUNS, 1);
+    A2I_PROFILE_COUNT(COUNTER_DROPPED, (lag + hop - 1) / hop);
+  }
+
+  for(; next_frame_end <= end; next_frame_end += hop)
+  {
+    addWindows(next_frame_end);
+    fft();
+    normalize(multiplier);
+
+    if(!queue.empty())
+    {
+      if(queue_count == queue.size())
+      {
+        queue_head = (queue_head + 1) % queue.size();
+        --queue_count;
+        A2I_PROFILE_COUNT(COUNTER_LATE, 1);
+      }
+
+      queue[(queue_head + queue_count) % queue.size()] = out;
+      ++queue_count;
+    }
+
+    ++produced;
+  }
+
+  A2I_PROFILE_COUNT(COUNTER_FRAMES, produced);
+  return produced;
+}
+
+bool a2i::MultiChannelSpectrogram::popSpectra(std::vector<Spectrum>& spectra)
+{
+  if(queue_count == 0)
+  {
+    return false;
+  }
+
+  std::swap(spectra, queue[queue_head]);
+  queue_head = (queue_head + 1) % queue.size();
+  --queue_count;
+
+  return true;
+}
+
+void a2i::MultiChannelSpectrogram::addWindows(uint64_t frame_end)
+{
+  A2I_PROFILE_SCOPE(STAGE_WINDOW);
+
+  const float* window = window_table->data();
+
+  for(unsigned int c = 0; c < channels; ++c)
+  {
+    float* dst = fft_in.get() + static_cast<size_t>(c) * frame_size;
+    const float* a = in[c].at(frame_end, frame_size);
+
+    if(channel_mode == MID_SIDE && c + 1 < channels)
+    {
+      const float* b = in[c + 1].at(frame_end, frame_size);
+      float* side = dst + frame_size;
+
+      for(size_t i = 0; i < frame_size; ++i)
+      {
+        dst[i] = 0.5f * (a[i] + b[i]) * window[i];
+        side[i] = 0.5f * (a[i] - b[i]) * window[i];
+      }
+
+      ++c;
+      continue;
+    }
+
+    for(size_t i = 0; i < frame_size; ++i)
+    {
+      dst[i] = a[i] * window[i];
+    }
+  }
+}
+
+void a2i::MultiChannelSpectrogram::fft()
+{
+  A2I_PROFILE_SCOPE(STAGE_FFT);
+
+  if(plan_generation != Spectrogram::planGeneration())
+  {
+    plan_generation = Spectrogram::planGeneration();
+    plan = Spectrogram::getPlan(frame_size, planner_flag, channels);
+  }
+
+  fftwf_execute_dft_r2c(plan, fft_in.get(), fft_buf.get());
+}
+
+void a2i::MultiChannelSpectrogram::normalize(const int multiplier)
+{
+  A2I_PROFILE_SCOPE(STAGE_NORMALIZE);
+
+  const size_t bins = frame_size / 2;
+  const size_t stride = frame_size / 2 + 1;
+  const auto* spectra = reinterpret_cast<const std::complex<float>*>(fft_buf.get());
+
+  if(channel_mode != SUM)
+  {
+    auto kernel = normalize_mode == EXACT ? dsp::powerToDbExact : dsp::powerToDb;
+
+    for(unsigned int c = 0; c < channels; ++c)
+    {
+      kernel(spectra + c * stride, out[c].data(), bins, 1.0f / frame_size,
+        multiplier, db_range.first, db_range.second);
+    }
+    return;
+  }
+
+  std::fill(power.begin(), power.end(), 0.0f);
+
+  for(unsigned int c = 0; c < channels; ++c)
+  {
+    const std::complex<float>* x = spectra + c * stride;
+    for(size_t i = 0; i < bins; ++i)
+    {
+      power[i] += std::norm(x[i]);
+    }
+  }
+
+  auto kernel = normalize_mode == EXACT ? dsp::powerValuesToDbExact : dsp::powerValuesToDb;
+  kernel(power.data(), out[0].data(), bins, 1.0f / frame_size,
+    multiplier, db_range.first, db_range.second);
+}
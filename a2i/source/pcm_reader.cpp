@@ -0,0 +1,228 @@
+#include "pcm_reader.hpp"
+
+#include <string.h>
+#include <errno.h>
+
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#else
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+  size_t sampleSize(const int format)
+  {
+    return format == a2i::S16 ? sizeof(int16_t) : sizeof(float);
+  }
+
+  // samples are taken as host order, which is little-endian on every target we build for
+  template<typename T>
+  void downmix(const uint8_t* src, float* dst, size_t frames, unsigned int channels, float scale)
+  {
+    for(size_t i = 0; i < frames; ++i)
+    {
+      float sum = 0;
+      for(unsigned int c = 0; c < channels; ++c)
+      {
+        T value;
+        memcpy(&value, src + (i * channels + c) * sizeof(T), sizeof(T));
+        sum += value;
+      }
+      dst[i] = sum * scale;
+    }
+  }
+
+  template<typename T>
+  void convert(const uint8_t* src, float* dst, size_t samples, float scale)
+  {
+    for(size_t i = 0; i < samples; ++i)
+    {
+      T value;
+      memcpy(&value, src + i * sizeof(T), sizeof(T));
+      dst[i] = value * scale;
+    }
+  }
+}
+
+a2i::PcmReader::~PcmReader()
+{
+  close();
+}
+
+bool a2i::PcmReader::open(
+  const std::string& path,
+  const int format,
+  const unsigned int channels,
+  const size_t block_frames)
+{
+  close();
+
+  if(channels == 0 || block_frames == 0 || (format != S16 && format != F32))
+  {
+    return false;
+  }
+
+  if(path == "-")
+  {
+#ifdef _WIN32
+    fd = _fileno(stdin);
+    _setmode(fd, _O_BINARY);
+#else
+    fd = STDIN_FILENO;
+#endif
+    owns_fd = false;
+  }
+  else
+  {
+#ifdef _WIN32
+    fd = _open(path.c_str(), _O_RDONLY | _O_BINARY);
+#else
+    fd = ::open(path.c_str(), O_RDONLY);
+#endif
+    owns_fd = true;
+  }
+
+  if(fd < 0)
+  {
+    return false;
+  }
+
+  this->format = format;
+  this->channels = channels;
+  frame_bytes = channels * sampleSize(format);
+  buffer.assign(block_frames * frame_bytes, 0);
+  pending = 0;
+  frames_read = 0;
+  end = false;
+  return true;
+}
+
+size_t a2i::PcmReader::read(float* mono, const int timeout_ms)
+{
+  return decode(mono, timeout_ms, true);
+}
+
+size_t a2i::PcmReader::readInterleaved(float* samples, const int timeout_ms)
+{
+  return decode(samples, timeout_ms, false);
+}
+
+size_t a2i::PcmReader::decode(float* dst, const int timeout_ms, const bool mono)
+{
+  if(fd < 0)
+  {
+    return 0;
+  }
+
+  while(pending < frame_bytes)
+  {
+    if(!fill(timeout_ms)) return 0;
+  }
+
+  size_t count = pending / frame_bytes;
+
+  if(mono && format == S16)
+  {
+    downmix<int16_t>(buffer.data(), dst, count, channels, 1.0f / (32768.0f * channels));
+  }
+  else if(mono)
+  {
+    downmix<float>(buffer.data(), dst, count, channels, 1.0f / channels);
+  }
+  else if(format == S16)
+  {
+    convert<int16_t>(buffer.data(), dst, count * channels, 1.0f / 32768.0f);
+  }
+  else
+  {
+    convert<float>(buffer.data(), dst, count * channels, 1.0f);
+  }
+
+  size_t used = count * frame_bytes;
+  memmove(buffer.data(), buffer.data() + used, pending - used);
+  pending -= used;
+  frames_read += count;
+  return count;
+}
+
+bool a2i::PcmReader::fill(const int timeout_ms)
+{
+  if(end)
+  {
+    return false;
+  }
+
+#ifdef _WIN32
+  (void)timeout_ms;
+  int n = _read(fd, buffer.data() + pending, static_cast<unsigned int>(buffer.size() - pending));
+#else
+  if(timeout_ms >= 0)
+  {
+    pollfd descriptor{fd, POLLIN, 0};
+    int ready = poll(&descriptor, 1, timeout_ms);
+    if(ready == 0 || (ready < 0 && errno == EINTR)) return false;
+  }
+
+  ssize_t n;
+  do
+  {
+    n = ::read(fd, buffer.data() + pending, buffer.size() - pending);
+  } while(n < 0 && errno == EINTR);
+#endif
+
+  if(n <= 0)
+  {
+    end = true;
+    return false;
+  }
+
+  pending += static_cast<size_t>(n);
+  return true;
+}
+
+void a2i::PcmReader::close()
+{
+  if(fd >= 0 && owns_fd)
+  {
+#ifdef _WIN32
+    _close(fd);
+#else
+    ::close(fd);
+#endif
+  }
+
+  fd = -1;
+  owns_fd = false;
+  pending = 0;
+}
+
+bool a2i::PcmReader::eof() const
+{
+  return end;
+}
+
+size_t a2i::PcmReader::blockFrames() const
+{
+  return frame_bytes ? buffer.size() / frame_bytes : 0;
+}
+
+unsigned int a2i::PcmReader::getChannels() const
+{
+  return channels;
+}
+
+uint64_t a2i::PcmReader::frames() const
+{
+  return frames_read;
+}
+
+int a2i::PcmReader::parseFormat(const std::string& name)
+{
+  if(name == "s16" || name == "s16le") return S16;
+  if(name == "f32" || name == "f32le") return F32;
+  return -1;
+}
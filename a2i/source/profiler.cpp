@@ -0,0 +1,166 @@
+#include "profiler.hpp"
+
+#include <bit>
+#include <iomanip>
+#include <sstream>
+
+
+a2i::Profiler& a2i::Profiler::instance()
+{
+  static Profiler profiler;
+  return profiler;
+}
+
+void a2i::Profiler::record(int index, uint64_t ns)
+{
+  Stage& s = stages[index];
+  s.count.fetch_add(1, std::memory_order_relaxed);
+  s.total_ns.fetch_add(ns, std::memory_order_relaxed);
+  s.histogram[std::min<int>(std::bit_width(ns), buckets - 1)].fetch_add(1, std::memory_order_relaxed);
+
+  uint64_t max = s.max_ns.load(std::memory_order_relaxed);
+  while(ns > max && !s.max_ns.compare_exchange_weak(max, ns, std::memory_order_relaxed));
+}
+
+void a2i::Profiler::count(int index, uint64_t n)
+{
+  counters[index].fetch_add(n, std::memory_order_relaxed);
+}
+
+void a2i::Profiler::reset()
+{
+  for(auto& s : stages)
+  {
+    s.count = 0;
+    s.total_ns = 0;
+    s.max_ns = 0;
+    for(auto& bucket : s.histogram) bucket = 0;
+  }
+
+  for(auto& c : counters) c = 0;
+}
+
+a2i::StageStats a2i::Profiler::stage(int index) const
+{
+  const Stage& s = stages[index];
+
+  StageStats stats;
+  stats.count = s.count.load(std::memory_order_relaxed);
+  stats.total_ns = s.total_ns.load(std::memory_order_relaxed);
+  stats.max_ns = s.max_ns.load(std::memory_order_relaxed);
+  stats.mean_ns = stats.count ? static_cast<double>(stats.total_ns) / stats.count : 0;
+
+  std::array<uint64_t, buckets> histogram;
+  uint64_t samples = 0;
+  for(int i = 0; i < buckets; ++i)
+  {
+    histogram[i] = s.histogram[i].load(std::memory_order_relaxed);
+    samples += histogram[i];
+  }
+
+  // bucket i holds durations in [2^(i-1), 2^i)
+  uint64_t seen = 0;
+  bool median = false;
+  for(int i = 0; i < buckets && samples; ++i)
+  {
+    seen += histogram[i];
+    uint64_t upper = i ? (uint64_t(1) << i) - 1 : 0;
+    if(!median && seen * 2 >= samples)
+    {
+      stats.p50_ns = std::min(upper, stats.max_ns);
+      median = true;
+    }
+    if(seen * 100 >= samples * 99)
+    {
+      stats.p99_ns = std::min(upper, stats.max_ns);
+      break;
+    }
+  }
+
+  return stats;
+}
+
+uint64_t a2i::Profiler::counter(int index) const
+{
+  return counters[index].load(std::memory_order_relaxed);
+}
+
+std::string a2i::Profiler::json() const
+{
+  std::ostringstream ss;
+  ss << std::fixed << std::setprecision(0);
+  ss << "{\n  \"enabled\": " << (enabled() ? "true" : "false") << ",\n  \"stages\": {\n";
+
+  for(int i = 0; i < STAGE_COUNT; ++i)
+  {
+    StageStats s = stage(i);
+    ss << "    \"" << stageName(i) << "\": {"
+       << "\"count\": " << s.count 
+       << ", \"mean_ns\": " << s.mean_ns 
+       << ", \"p50_ns\": " << s.p50_ns 
+       << ", \"p99_ns\": " << s.p99_ns 
+       << ", \"max_ns\": " << s.max_ns << "}"
+       << (i + 1 < STAGE_COUNT ? ",\n" : "\n");
+  }
+
+  ss << "  },\n  \"counters\": {\n";
+  for(int i = 0; i < COUNTER_COUNT; ++i)
+  {
+    ss << "    \"" << counterName(i) << "\": " << counter(i) << (i + 1 < COUNTER_COUNT ? ",\n" : "\n");
+  }
+  ss << "  }\n}\n";
+
+  return ss.str();
+}
+
+std::string a2i::Profiler::csvHeader() const
+{
+  std::ostringstream ss;
+  for(int i = 0; i < STAGE_COUNT; ++i)
+  {
+    ss << stageName(i) << "_count," << stageName(i) << "_mean_ns," 
+       << stageName(i) << "_p99_ns," << stageName(i) << "_max_ns,";
+  }
+  for(int i = 0; i < COUNTER_COUNT; ++i)
+  {
+    ss << counterName(i) << (i + 1 < COUNTER_COUNT ? "," : "\n");
+  }
+  return ss.str();
+}
+
+std::string a2i::Profiler::csvRow() const
+{
+  std::ostringstream ss;
+  ss << std::fixed << std::setprecision(0);
+  for(int i = 0; i < STAGE_COUNT; ++i)
+  {
+    StageStats s = stage(i);
+    ss << s.count << ',' << s.mean_ns << ',' << s.p99_ns << ',' << s.max_ns << ',';
+  }
+  for(int i = 0; i < COUNTER_COUNT; ++i)
+  {
+    ss << counter(i) << (i + 1 < COUNTER_COUNT ? "," : "\n");
+  }
+  return ss.str();
+}
+
+const char* a2i::Profiler::stageName(int index)
+{
+  static const char* names[] = {"window", "fft", "normalize", "draw", "composite", "show"};
+  return index >= 0 && index < STAGE_COUNT ? names[index] : "unknown";
+}
+
+const char* a2i::Profiler::counterName(int index)
+{
+  static const char* names[] = {"frames", "dropped", "late", "overruns"};
+  return index >= 0 && index < COUNTER_COUNT ? names[index] : "unknown";
+}
+
+bool a2i::Profiler::enabled()
+{
+#ifdef A2I_PROFILE
+  return true;
+#else
+  return false;
+#endif
+}
@@ -0,0 +1,112 @@
+#include "render_context.hpp"
+#include "profiler.hpp"
+
+
+a2i::RenderContext::RenderContext(Spectrogram& spectrogram, int rows, int cols) : 
+  spectrogram(spectrogram),
+  grid(spectrogram)
+{
+  resize(rows, cols);
+}
+
+void a2i::RenderContext::resize(int rows, int cols)
+{
+  canvas.create(rows, cols, CV_8UC3);
+  layer.create(rows, cols, CV_8UC3);
+  output.create(rows, cols, CV_8UC3);
+  trail.clear();
+}
+
+void a2i::RenderContext::setStyle(const RenderStyle& new_style)
+{
+  style = new_style;
+  grid.setGraphMode(style.graph_mode);
+
+  palette.release();
+  if(style.colormap >= 0)
+  {
+    palette = makePalette(style.colormap);
+  }
+}
+
+void a2i::RenderContext::setGrid(
+  const bool enabled, 
+  const cv::Scalar line_color, 
+  const cv::Scalar text_color)
+{
+  grid_enabled = enabled;
+  grid.setColors(line_color, text_color);
+}
+
+void a2i::RenderContext::setTrail(int frames)
+{
+  trail.setFrames(frames);
+}
+
+const cv::Mat& a2i::RenderContext::render(const Spectrum& spectrum)
+{
+  layer.setTo(cv::Scalar(0, 0, 0));
+  spectrogram.drawSpectrum(
+    layer, 
+    spectrum, 
+    style.line_type, 
+    style.graph_mode, 
+    style.fill_type, 
+    style.border_line, 
+    style.line_color, 
+    style.underline_color, 
+    style.gradient_coefficient);
+
+  A2I_PROFILE_SCOPE(STAGE_COMPOSITE);
+
+  canvas.setTo(style.background);
+  if(grid_enabled) grid.blend(canvas);
+  trail.compose(canvas, layer);
+
+  if(palette.empty())
+  {
+    return canvas;
+  }
+
+  applyColormap();
+  return output;
+}
+
+const cv::Mat& a2i::RenderContext::frame() const
+{
+  return palette.empty() ? canvas : output;
+}
+
+cv::Mat a2i::RenderContext::makePalette(int colormap)
+{
+  // colour of every gray level as a 1x256 BGR table, gray for colormap < 0
+  cv::Mat ramp(1, 256, CV_8UC1);
+  for(int i = 0; i < 256; ++i)
+  {
+    ramp.at<uchar>(0, i) = i;
+  }
+
+  cv::Mat palette;
+  if(colormap >= 0) cv::applyColorMap(ramp, palette, colormap);
+  else cv::cvtColor(ramp, palette, cv::COLOR_GRAY2BGR);
+
+  return palette;
+}
+
+void a2i::RenderContext::applyColormap()
+{
+  // same gray conversion as cv::applyColorMap(), without its temporaries
+  const cv::Vec3b* colors = palette.ptr<cv::Vec3b>(0);
+
+  for(int y = 0; y < canvas.rows; ++y)
+  {
+    const uchar* __restrict src = canvas.ptr<uchar>(y);
+    cv::Vec3b* __restrict dst = output.ptr<cv::Vec3b>(y);
+
+    for(int x = 0; x < canvas.cols; ++x)
+    {
+      const int gray = (src[3 * x] * 1868 + src[3 * x + 1] * 9617 + src[3 * x + 2] * 4899 + (1 << 13)) >> 14;
+      dst[x] = colors[gray];
+    }
+  }
+}
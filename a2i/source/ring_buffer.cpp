@@ -0,0 +1,84 @@
+#include "ring_buffer.hpp"
+
+#include <string.h>
+#include <algorithm>
+#include <bit>
+
+
+a2i::RingBuffer::RingBuffer(size_t size)
+{
+  resize(size);
+}
+
+void a2i::RingBuffer::resize(size_t size)
+{
+  buffer_capacity = std::bit_ceil(std::max<size_t>(size, 1));
+  mask = buffer_capacity - 1;
+
+  size_t bytes = sizeof(float) * buffer_capacity * 2;
+  buffer.reset(static_cast<float*>(::operator new[](bytes, std::align_val_t(cache_line))));
+
+  clear();
+}
+
+void a2i::RingBuffer::clear()
+{
+  if(buffer)
+  {
+    memset(buffer.get(), 0, sizeof(float) * buffer_capacity * 2);
+  }
+
+  write_pos.store(0, std::memory_order_release);
+}
+
+void a2i::RingBuffer::write(size_t index, const float* data, size_t n)
+{
+  memcpy(buffer.get() + index, data, sizeof(float) * n);
+  memcpy(buffer.get() + index + buffer_capacity, data, sizeof(float) * n);
+}
+
+void a2i::RingBuffer::push(const float* data, size_t n)
+{
+  uint64_t pos = write_pos.load(std::memory_order_relaxed);
+
+  // only the newest capacity samples can survive the write
+  if(n > buffer_capacity)
+  {
+    pos += n - buffer_capacity;
+    data += n - buffer_capacity;
+    n = buffer_capacity;
+  }
+
+  size_t index = pos & mask;
+  size_t first = std::min(n, buffer_capacity - index);
+
+  write(index, data, first);
+  write(0, data + first, n - first);
+
+  write_pos.store(pos + n, std::memory_order_release);
+}
+
+const float* a2i::RingBuffer::latest(size_t n) const
+{
+  return at(written(), n);
+}
+
+const float* a2i::RingBuffer::at(uint64_t end, size_t n) const
+{
+  return buffer.get() + ((end - n) & mask);
+}
+
+uint64_t a2i::RingBuffer::written() const
+{
+  return write_pos.load(std::memory_order_acquire);
+}
+
+size_t a2i::RingBuffer::size() const
+{
+  return static_cast<size_t>(std::min<uint64_t>(written(), buffer_capacity));
+}
+
+size_t a2i::RingBuffer::capacity() const
+{
+  return buffer_capacity;
+}
@@ -1,5 +1,72 @@
 #include "spectrogram.hpp"
+#include "dsp.hpp"
+#include "profiler.hpp"
 
+#include <atomic>
+#include <mutex>
+#include <numeric>
+#include <tuple>
+
+namespace
+{
+  // FFTW planner is not thread-safe, plans are shared between instances
+  std::mutex plan_mutex;
+  std::map<std::tuple<unsigned int, unsigned int, unsigned int>, fftwf_plan> plan_cache;
+  std::atomic<unsigned int> cache_generation{0};  // bumped by clearPlans()
+
+  // window tables are read-only once built and shared between instances
+  std::mutex window_mutex;
+  std::map<std::pair<int, unsigned int>, std::shared_ptr<const std::vector<float>>> window_cache;
+
+  void multiply(float* __restrict dst, const float* __restrict a, const float* __restrict b, size_t n)
+  {
+    for(size_t i = 0; i < n; ++i)
+    {
+      dst[i] = a[i] * b[i];
+    }
+  }
+
+  // same as multiply(), also sums the squares and tracks the peak of a
+  void multiply(float* __restrict dst, const float* __restrict a, const float* __restrict b, size_t n, float& squares, float& peak)
+  {
+    float sum = 0;
+    float max = 0;
+
+    for(size_t i = 0; i < n; ++i)
+    {
+      dst[i] = a[i] * b[i];
+      sum += a[i] * a[i];
+      max = std::max(max, std::abs(a[i]));
+    }
+
+    squares = sum;
+    peak = max;
+  }
+}
+
+a2i::Spectrogram::Spectrogram(const Spectrogram& other) :
+  bin_aggregation(other.bin_aggregation),
+  filterbank(other.filterbank),
+  filterbank_scale(other.filterbank_scale),
+  filterbank_bands(other.filterbank_bands),
+  features_enabled(other.features_enabled),
+  window_type(other.window_type),
+  planner_flag(other.planner_flag),
+  normalize_mode(other.normalize_mode),
+  hop_size(other.hop_size),
+  overlap(other.overlap),
+  queue(other.queue.size()),
+  feature_queue(other.feature_queue.size()),
+  sample_rate(other.sample_rate),
+  db_range(other.db_range),
+  freq_range(other.freq_range)
+{
+  // settings are copied, buffers and history are not
+  if(other.frame_size)
+  {
+    setFrameSize(other.frame_size);
+  }
+}
 
 void a2i::Spectrogram::setAudioInfo(
   unsigned int audio_sample_rate,
@@ -7,52 +74,242 @@ void a2i::Spectrogram::setAudioInfo(
 {
   sample_rate = audio_sample_rate;
   db_range = audio_db_range;
+  updateFilterbank();
 }
 
 void a2i::Spectrogram::setFreqRange(std::pair<unsigned int, unsigned int> audio_freq_range)
 {
   freq_range = audio_freq_range;
+  updateFilterbank();
 }
 
 void a2i::Spectrogram::setFrameSize(int size) 
 {
   frame_size = size;
   out.resize(frame_size / 2);
-  fft_out.resize(frame_size);
-  window_out.resize(frame_size);
+  in.resize(std::max<size_t>(frame_size * 4, min_history));
+
+  fft_in.reset(fftwf_alloc_real(frame_size));
+  fft_buf.reset(fftwf_alloc_complex(frame_size / 2 + 1));
+  std::fill_n(fft_in.get(), frame_size, 0.0f);
+
+  // std::complex<float> is layout-compatible with fftwf_complex
+  fft_out = std::span<std::complex<float>>(
+    reinterpret_cast<std::complex<float>*>(fft_buf.get()), frame_size / 2 + 1);
+
+  plan_generation = planGeneration();
+  plan = getPlan(frame_size, planner_flag);
+
+  next_frame_end = frame_size;
+  previous_out.clear();
+  queue_head = 0;
+  queue_count = 0;
+
+  if(window_type >= 0)
+  {
+    setWindowFunc(window_type);
+  }
+
+  updateFilterbank();
+}
+
+void a2i::Spectrogram::setHopSize(unsigned int size)
+{
+  hop_size = size;
+}
+
+void a2i::Spectrogram::setOverlap(float percent)
+{
+  overlap = std::clamp(percent, 0.0f, 99.0f);
+  hop_size = 0;
+}
+
+void a2i::Spectrogram::setQueueSize(size_t size)
+{
+  queue.assign(size, Spectrum());
+  feature_queue.assign(size, Features());
+  queue_head = 0;
+  queue_count = 0;
+}
+
+unsigned int a2i::Spectrogram::getHopSize() const
+{
+  if(hop_size)
+  {
+    return hop_size;
+  }
+
+  return std::max(1u, static_cast<unsigned int>(frame_size * (1.0f - overlap / 100.0f)));
+}
+
+unsigned int a2i::Spectrogram::getFrameSize() const
+{
+  return frame_size;
+}
+
+unsigned int a2i::Spectrogram::getSampleRate() const
+{
+  return sample_rate;
 }
 
+std::pair<int, int> a2i::Spectrogram::getDbRange() const
+{
+  return db_range;
+}
+
+std::pair<unsigned int, unsigned int> a2i::Spectrogram::getFreqRange() const
+{
+  return freq_range;
+}
+
+int a2i::Spectrogram::getWindowFunc() const
+{
+  return window_type;
+}
+
+void a2i::Spectrogram::setPlannerFlag(unsigned int flag)
+{
+  planner_flag = flag;
+
+  if(frame_size)
+  {
+    plan_generation = planGeneration();
+    plan = getPlan(frame_size, planner_flag);
+  }
+}
+
+fftwf_plan a2i::Spectrogram::getPlan(unsigned int size, unsigned int flag, unsigned int howmany)
+{
+  std::lock_guard<std::mutex> lock(plan_mutex);
+
+  auto it = plan_cache.find({size, flag, howmany});
+  if(it != plan_cache.end())
+  {
+    return it->second;
+  }
+
+  // MEASURE/PATIENT overwrite the arrays while planning, so plan on scratch
+  // buffers and run the plan on the instance buffers with fftwf_execute_dft_r2c
+  float* scratch_in = fftwf_alloc_real(static_cast<size_t>(size) * howmany);
+  fftwf_complex* scratch_out = fftwf_alloc_complex(static_cast<size_t>(size / 2 + 1) * howmany);
+
+  fftwf_plan p;
+  if(howmany == 1)
+  {
+    p = fftwf_plan_dft_r2c_1d(size, scratch_in, scratch_out, flag);
+  }
+  else
+  {
+    // howmany transforms back to back, one per channel
+    const int n = size;
+    p = fftwf_plan_many_dft_r2c(1, &n, howmany, 
+      scratch_in, nullptr, 1, size, 
+      scratch_out, nullptr, 1, size / 2 + 1, flag);
+  }
+
+  fftwf_free(scratch_in);
+  fftwf_free(scratch_out);
+
+  plan_cache[{size, flag, howmany}] = p;
+  return p;
+}
+
+bool a2i::Spectrogram::loadWisdom(const std::string& path)
+{
+  std::lock_guard<std::mutex> lock(plan_mutex);
+  return fftwf_import_wisdom_from_filename(path.c_str()) != 0;
+}
+
+bool a2i::Spectrogram::saveWisdom(const std::string& path)
+{
+  std::lock_guard<std::mutex> lock(plan_mutex);
+  return fftwf_export_wisdom_to_filename(path.c_str()) != 0;
+}
+
+void a2i::Spectrogram::clearPlans()
+{
+  std::lock_guard<std::mutex> lock(plan_mutex);
+
+  for(auto& [key, p] : plan_cache)
+  {
+    fftwf_destroy_plan(p);
+  }
+
+  plan_cache.clear();
+  fftwf_cleanup();
+  cache_generation.fetch_add(1, std::memory_order_release);
+}
+
+unsigned int a2i::Spectrogram::planGeneration()
+{
+  return cache_generation.load(std::memory_order_acquire);
+}
+
+const std::vector<a2i::Spectrogram::windowFuncType> a2i::Spectrogram::windows = {
+  &Spectrogram::windowSine,
+  &Spectrogram::windowHann,
+  &Spectrogram::windowHamming,
+  &Spectrogram::windowBlackman,
+  &Spectrogram::windowNuttall,
+  &Spectrogram::windowBlackmanNuttall,
+  &Spectrogram::windowBlackmanHarris,
+  &Spectrogram::windowFlatTop,
+  &Spectrogram::windowBartlettHann,
+  &Spectrogram::windowHannPoisson
+};
+
 void a2i::Spectrogram::setWindowFunc(int type) 
 {
-  (this->*windows[type])();
+  window_type = type;
+  window_table = getWindowTable(type, frame_size);
+  window_out = std::span<const float>(*window_table);
 }
 
-void a2i::Spectrogram::windowSine()
+std::shared_ptr<const std::vector<float>> a2i::Spectrogram::getWindowTable(int type, unsigned int size)
 {
+  std::lock_guard<std::mutex> lock(window_mutex);
+
+  auto& cached = window_cache[{type, size}];
+  if(!cached)
+  {
+    auto table = std::make_shared<std::vector<float>>(size);
+    windows[type](*table);
+    cached = table;
+  }
+
+  return cached;
+}
+
+void a2i::Spectrogram::windowSine(std::vector<float>& window)
+{
+  const size_t frame_size = window.size();
   for(size_t i = 0; i < static_cast<size_t>(frame_size); ++i)
   {
-    window_out[i] = sin(M_PI * i / (frame_size * 2));
+    window[i] = sin(M_PI * i / (frame_size * 2));
   }
 }
 
-void a2i::Spectrogram::windowHann() 
+void a2i::Spectrogram::windowHann(std::vector<float>& window) 
 {
+  const size_t frame_size = window.size();
   for(size_t i = 0; i < static_cast<size_t>(frame_size); ++i)
   {
-    window_out[i] = 0.5 * (1.0 - cos((2.0 * M_PI * i) / (frame_size)));
+    window[i] = 0.5 * (1.0 - cos((2.0 * M_PI * i) / (frame_size)));
   }
 }
 
-void a2i::Spectrogram::windowHamming()
+void a2i::Spectrogram::windowHamming(std::vector<float>& window)
 {
+  const size_t frame_size = window.size();
   for(size_t i = 0; i < static_cast<size_t>(frame_size); ++i)
   {
-    window_out[i] = (25. / 46) * (1.0 - cos((2.0 * M_PI * i) / (frame_size * 2)));
+    window[i] = (25. / 46) * (1.0 - cos((2.0 * M_PI * i) / (frame_size * 2)));
   }
 }
 
-void a2i::Spectrogram::windowBlackman()
+void a2i::Spectrogram::windowBlackman(std::vector<float>& window)
 {
+  const size_t frame_size = window.size();
   float alfa = 0.16;
   float a0 = (1. - alfa) / 2;
   float a1 = 1 / 2;
@@ -60,12 +317,13 @@ void a2i::Spectrogram::windowBlackman()
 
   for(size_t i = 0; i < static_cast<size_t>(frame_size); ++i)
   {
-    window_out[i] = a0 - a1 * cos((2.0 * M_PI * i) / (frame_size * 2)) + a2 * cos((4.0 * M_PI * i) / (frame_size * 2));
+    window[i] = a0 - a1 * cos((2.0 * M_PI * i) / (frame_size * 2)) + a2 * cos((4.0 * M_PI * i) / (frame_size * 2));
   }
 }
 
-void a2i::Spectrogram::windowNuttall()
+void a2i::Spectrogram::windowNuttall(std::vector<float>& window)
 {
+  const size_t frame_size = window.size();
   float a0 = 0.355768;
   float a1 = 0.487396;
   float a2 = 0.144232;
@@ -73,12 +331,13 @@ void a2i::Spectrogram::windowNuttall()
 
   for(size_t i = 0; i < static_cast<size_t>(frame_size); ++i)
   {
-    window_out[i] = a0 - a1 * cos((2.0 * M_PI * i) / (frame_size * 2)) + a2 * cos((4.0 * M_PI * i) / (frame_size * 2)) - a3 * cos((6.0 * M_PI * i) / (frame_size * 2));
+    window[i] = a0 - a1 * cos((2.0 * M_PI * i) / (frame_size * 2)) + a2 * cos((4.0 * M_PI * i) / (frame_size * 2)) - a3 * cos((6.0 * M_PI * i) / (frame_size * 2));
   }
 }
 
-void a2i::Spectrogram::windowBlackmanNuttall()
+void a2i::Spectrogram::windowBlackmanNuttall(std::vector<float>& window)
 {
+  const size_t frame_size = window.size();
   float a0 = 0.3635819;
   float a1 = 0.4891775;
   float a2 = 0.1365995;
@@ -86,12 +345,13 @@ void a2i::Spectrogram::windowBlackmanNuttall()
 
   for(size_t i = 0; i < static_cast<size_t>(frame_size); ++i)
   {
-    window_out[i] = a0 - a1 * cos((2.0 * M_PI * i) / (frame_size * 2)) + a2 * cos((4.0 * M_PI * i) / (frame_size * 2)) - a3 * cos((6.0 * M_PI * i) / (frame_size * 2));
+    window[i] = a0 - a1 * cos((2.0 * M_PI * i) / (frame_size * 2)) + a2 * cos((4.0 * M_PI * i) / (frame_size * 2)) - a3 * cos((6.0 * M_PI * i) / (frame_size * 2));
   }
 }
 
-void a2i::Spectrogram::windowBlackmanHarris()
+void a2i::Spectrogram::windowBlackmanHarris(std::vector<float>& window)
 {
+  const size_t frame_size = window.size();
   float a0 = 0.35875;
   float a1 = 0.48829;
   float a2 = 0.14128;
@@ -99,12 +359,13 @@ void a2i::Spectrogram::windowBlackmanHarris()
 
   for(size_t i = 0; i < static_cast<size_t>(frame_size); ++i)
   {
-    window_out[i] = a0 - a1 * cos((2.0 * M_PI * i) / (frame_size * 2)) + a2 * cos((4.0 * M_PI * i) / (frame_size * 2)) - a3 * cos((6.0 * M_PI * i) / (frame_size * 2));
+    window[i] = a0 - a1 * cos((2.0 * M_PI * i) / (frame_size * 2)) + a2 * cos((4.0 * M_PI * i) / (frame_size * 2)) - a3 * cos((6.0 * M_PI * i) / (frame_size * 2));
   }
 }
 
-void a2i::Spectrogram::windowFlatTop()
+void a2i::Spectrogram::windowFlatTop(std::vector<float>& window)
 {
+  const size_t frame_size = window.size();
   float a0 = 0.21557895;
   float a1 = 0.41663158;
   float a2 = 0.277263158;
@@ -113,77 +374,369 @@ void a2i::Spectrogram::windowFlatTop()
 
   for(size_t i = 0; i < static_cast<size_t>(frame_size); ++i)
   {
-    window_out[i] = a0 - a1 * cos((2.0 * M_PI * i) / (frame_size * 2)) + a2 * cos((4.0 * M_PI * i) / (frame_size * 2)) - a3 * cos((6.0 * M_PI * i) / (frame_size * 2)) + a4 * cos((8.0 * M_PI * i) / (frame_size * 2));
+    window[i] = a0 - a1 * cos((2.0 * M_PI * i) / (frame_size * 2)) + a2 * cos((4.0 * M_PI * i) / (frame_size * 2)) - a3 * cos((6.0 * M_PI * i) / (frame_size * 2)) + a4 * cos((8.0 * M_PI * i) / (frame_size * 2));
   }
 }
 
-void a2i::Spectrogram::windowBartlettHann()
+void a2i::Spectrogram::windowBartlettHann(std::vector<float>& window)
 {
+  const size_t frame_size = window.size();
   float a0 = 0.62;
   float a1 = 0.48;
   float a2 = 0.38;
 
   for(size_t i = 0; i < static_cast<size_t>(frame_size); ++i)
   {
-    window_out[i] = a0 - a1 * abs(static_cast<double>(i) / (frame_size * 2) - 1 / 2) - a2 * cos((2.0 * M_PI * i) / (frame_size * 2));
+    window[i] = a0 - a1 * abs(static_cast<double>(i) / (frame_size * 2) - 1 / 2) - a2 * cos((2.0 * M_PI * i) / (frame_size * 2));
   }
 }
 
-void a2i::Spectrogram::windowHannPoisson()
+void a2i::Spectrogram::windowHannPoisson(std::vector<float>& window)
 {
+  const size_t frame_size = window.size();
   float a = 2; // >= 2
 
   for(size_t i = 0; i < static_cast<size_t>(frame_size); ++i)
   {
-    window_out[i] = (1. / 2) *(1. - cos((2.0 * M_PI * i) / (frame_size * 2))) * pow(M_E, -a * abs(static_cast<double>(frame_size * 2 - 2 * i) / (frame_size * 2)));
+    window[i] = (1. / 2) *(1. - cos((2.0 * M_PI * i) / (frame_size * 2))) * pow(M_E, -a * abs(static_cast<double>(frame_size * 2 - 2 * i) / (frame_size * 2)));
   }
 }
 
 void a2i::Spectrogram::addWindow() 
 {
-  for(size_t i = 0; i < frame_size; ++i) 
+  addWindow(in.latest(frame_size));
+}
+
+void a2i::Spectrogram::addWindow(const float* src) 
+{
+  A2I_PROFILE_SCOPE(STAGE_WINDOW);
+
+  if(features_enabled)
+  {
+    float squares;
+    multiply(fft_in.get(), src, window_out.data(), frame_size, squares, frame_peak);
+    frame_rms = std::sqrt(squares / frame_size);
+  }
+  else
   {
-    in[i] *= window_out[i];
+    multiply(fft_in.get(), src, window_out.data(), frame_size);
+  }
+
+  if(raw_in)
+  {
+    std::copy_n(src, frame_size, raw_in.get());
   }
 }
 
 void a2i::Spectrogram::fft()
 {
-  double in1[frame_size];
-  fftw_complex out1[frame_size];
-  fftw_plan p;
+  A2I_PROFILE_SCOPE(STAGE_FFT);
+
+  // the cached plan was destroyed by clearPlans(), fetch a new one
+  if(plan_generation != planGeneration())
+  {
+    plan_generation = planGeneration();
+    plan = getPlan(frame_size, planner_flag);
+  }
+
+  fftwf_execute_dft_r2c(plan, fft_in.get(), fft_buf.get());
 
-  for(size_t i = 0; i < frame_size; i++)
+  if(raw_in)
   {
-    in1[i] = in[i];
+    fftwf_execute_dft_r2c(plan, raw_in.get(), raw_buf.get());
   }
+}
+
+void a2i::Spectrogram::setNormalizeMode(int mode)
+{
+  normalize_mode = mode;
+}
+
+void a2i::Spectrogram::setBinAggregation(int mode)
+{
+  bin_aggregation = mode;
+}
 
-  p = fftw_plan_dft_r2c_1d(frame_size, in1, out1, FFTW_ESTIMATE);
+void a2i::Spectrogram::setFilterbank(int scale, unsigned int number_of_bands)
+{
+  filterbank_scale = scale;
+  filterbank_bands = number_of_bands;
+  updateFilterbank();
+}
 
-  fftw_execute(p);
+const a2i::Filterbank* a2i::Spectrogram::getFilterbank() const
+{
+  return filterbank.get();
+}
+
+void a2i::Spectrogram::setFeatures(bool enabled)
+{
+  features_enabled = enabled;
+  features = Features();
+  previous_out.clear();
+}
 
-  for(size_t i = 0; i < frame_size / 2; i++)
+bool a2i::Spectrogram::getFeaturesEnabled() const
+{
+  return features_enabled;
+}
+
+void a2i::Spectrogram::updateFilterbank()
+{
+  if(!filterbank_bands || !frame_size || !sample_rate)
   {
-    fft_out[i] = std::complex<float>(out1[i][0], out1[i][1]);
+    filterbank.reset();
+    bands.clear();
+    raw_in.reset();
+    raw_buf.reset();
+    return;
   }
 
-  fftw_destroy_plan(p);
-  fftw_cleanup();
+  if(!filterbank || !filterbank->matches(filterbank_scale, filterbank_bands, frame_size, sample_rate, freq_range))
+  {
+    // constant-Q kernels are built with the FFTW planner
+    std::lock_guard<std::mutex> lock(plan_mutex);
+    filterbank = std::make_shared<const Filterbank>(filterbank_scale, filterbank_bands, frame_size, sample_rate, freq_range);
+  }
+
+  bands.resize(filterbank_bands);
+  band_power.resize(filterbank_bands);
+
+  // constant-Q kernels carry their own window, so they are applied to the
+  // FFT of the unwindowed frame
+  if(filterbank_scale != CQT)
+  {
+    raw_in.reset();
+    raw_buf.reset();
+  }
+  else if(!raw_in || raw_out.size() != frame_size / 2 + 1)
+  {
+    raw_in.reset(fftwf_alloc_real(frame_size));
+    raw_buf.reset(fftwf_alloc_complex(frame_size / 2 + 1));
+    std::fill_n(raw_in.get(), frame_size, 0.0f);
+    raw_out = std::span<std::complex<float>>(
+      reinterpret_cast<std::complex<float>*>(raw_buf.get()), frame_size / 2 + 1);
+  }
 }
 
 void a2i::Spectrogram::normalize(const int multiplier)
 {
-  for(size_t i = 0; i < frame_size / 2; ++i)
+  A2I_PROFILE_SCOPE(STAGE_NORMALIZE);
+
+  db_multiplier.store(multiplier, std::memory_order_relaxed);
+  auto kernel = normalize_mode == EXACT ? dsp::powerToDbExact : dsp::powerToDb;
+
+  if(features_enabled)
+  {
+    extractFeatures(kernel, multiplier);
+  }
+  else
   {
-    float db_value = multiplier * std::log10(std::norm(fft_out[i]) / frame_size + 1e-10);
+    kernel(fft_out.data(), out.data(), frame_size / 2, 1.0f / frame_size, 
+      multiplier, db_range.first, db_range.second);
+  }
 
-    if (db_value < db_range.first) db_value = db_range.first + 1;
-    if (db_value > db_range.second) db_value = db_range.first - 1;
+  if(filterbank)
+  {
+    filterbank->power(raw_in ? raw_out.data() : fft_out.data(), band_power.data());
 
-    out[i] = db_value;
+    auto values_kernel = normalize_mode == EXACT ? dsp::powerValuesToDbExact : dsp::powerValuesToDb;
+    values_kernel(band_power.data(), bands.data(), bands.size(), 1.0f / frame_size, 
+      multiplier, db_range.first, db_range.second);
   }
 }
 
+void a2i::Spectrogram::extractFeatures(normalizeKernel kernel, const int multiplier)
+{
+  // dB conversion and features run block by block, so every block is still
+  // in cache when its features are accumulated
+  constexpr size_t block = 1024;
+  constexpr float epsilon = 1e-10f;
+
+  const size_t n = frame_size / 2;
+  const float scale = 1.0f / frame_size;
+  const double hz_per_bin = static_cast<double>(sample_rate) / frame_size;
+  const bool has_previous = previous_out.size() == n;
+
+  if(!has_previous) previous_out.resize(n);
+  block_power.resize((n + block - 1) / block);
+
+  double total = 0;
+  double weighted = 0;
+  double log_sum = 0;
+  double flux = 0;
+  features.peak_count = 0;
+
+  for(size_t start = 0, b = 0; start < n; start += block, ++b)
+  {
+    const size_t end = std::min(start + block, n);
+    kernel(fft_out.data() + start, out.data() + start, end - start, scale, 
+      multiplier, db_range.first, db_range.second);
+
+    double sum = 0;
+    for(size_t k = start; k < end; ++k)
+    {
+      const float power = std::norm(fft_out[k]) * scale;
+      sum += power;
+      weighted += power * k;
+      log_sum += dsp::fastLog2(power + epsilon);
+
+      const float rise = out[k] - previous_out[k];
+      flux += rise > 0 ? rise : 0;
+      previous_out[k] = out[k];
+    }
+
+    block_power[b] = sum;
+    total += sum;
+
+    // a bin is checked once both neighbours are converted
+    for(size_t k = std::max<size_t>(start, 2) - 1; k + 1 < end; ++k)
+    {
+      if(out[k] > out[k - 1] && out[k] >= out[k + 1])
+      {
+        addPeak(k);
+      }
+    }
+  }
+
+  for(size_t i = 0; i < features.peak_count; ++i)
+  {
+    features.peaks[i].frequency *= hz_per_bin;
+  }
+
+  features.centroid = total > 0 ? weighted / total * hz_per_bin : 0;
+  features.flatness = std::exp2(log_sum / n) / (total / n + epsilon);
+  features.flux = has_previous ? flux / n : 0;
+
+  // only the block where the cumulative power crosses 85% is rescanned
+  features.rolloff = 0;
+  double threshold = 0.85 * total;
+  for(size_t start = 0, b = 0; start < n && total > 0; start += block, ++b)
+  {
+    if(threshold > block_power[b])
+    {
+      threshold -= block_power[b];
+      continue;
+    }
+
+    size_t k = start;
+    for(; k + 1 < std::min(start + block, n); ++k)
+    {
+      threshold -= std::norm(fft_out[k]) * scale;
+      if(threshold <= 0) break;
+    }
+
+    features.rolloff = k * hz_per_bin;
+    break;
+  }
+
+  // amplitudes, so dBFS and not the power multiplier of the spectrum
+  features.rms = 20 * std::log10(frame_rms + epsilon);
+  features.peak = 20 * std::log10(frame_peak + epsilon);
+}
+
+void a2i::Spectrogram::addPeak(size_t bin)
+{
+  const float left = out[bin - 1];
+  const float center = out[bin];
+  const float right = out[bin + 1];
+
+  // vertex of the parabola through the three bins
+  const float curvature = left - 2 * center + right;
+  const float offset = curvature != 0 ? 0.5f * (left - right) / curvature : 0.0f;
+  const Peak peak = {bin + offset, center - 0.25f * (left - right) * offset};
+
+  auto& peaks = features.peaks;
+  size_t& count = features.peak_count;
+
+  if(count == Features::max_peaks && peak.db <= peaks[count - 1].db)
+  {
+    return;
+  }
+
+  size_t i = std::min(count, Features::max_peaks - 1);
+  for(; i > 0 && peaks[i - 1].db < peak.db; --i)
+  {
+    peaks[i] = peaks[i - 1];
+  }
+
+  peaks[i] = peak;
+  count = std::min(count + 1, Features::max_peaks);
+}
+
+void a2i::Spectrogram::push(const float* samples, size_t n)
+{
+  in.push(samples, n);
+}
+
+size_t a2i::Spectrogram::process(const int multiplier)
+{
+  const uint64_t end = in.written();
+  const unsigned int hop = getHopSize();
+  size_t produced = 0;
+
+  // frames that were already overwritten in the history are skipped
+  if(end > next_frame_end && end - next_frame_end > in.capacity() - frame_size)
+  {
+    uint64_t lag = end - next_frame_end - (in.capacity() - frame_size);
+    next_frame_end += (lag + hop - 1) / hop * hop;
+
+    A2I_PROFILE_COUNT(COUNTER_OVERRUNS, 1);
+    A2I_PROFILE_COUNT(COUNTER_DROPPED, (lag + hop - 1) / hop);
+  }
+
+  for(; next_frame_end <= end; next_frame_end += hop)
+  {
+    addWindow(in.at(next_frame_end, frame_size));
+    fft();
+    normalize(multiplier);
+
+    if(!queue.empty())
+    {
+      if(queue_count == queue.size())
+      {
+        queue_head = (queue_head + 1) % queue.size();
+        --queue_count;
+        A2I_PROFILE_COUNT(COUNTER_LATE, 1);
+      }
+
+      queue[(queue_head + queue_count) % queue.size()] = out;
+      feature_queue[(queue_head + queue_count) % queue.size()] = features;
+      ++queue_count;
+    }
+
+    ++produced;
+  }
+
+  A2I_PROFILE_COUNT(COUNTER_FRAMES, produced);
+  return produced;
+}
+
+bool a2i::Spectrogram::popSpectrum(Spectrum& spectrum, Features& frame_features)
+{
+  if(queue_count == 0)
+  {
+    return false;
+  }
+
+  frame_features = feature_queue[queue_head];
+  return popSpectrum(spectrum);
+}
+
+bool a2i::Spectrogram::popSpectrum(Spectrum& spectrum)
+{
+  if(queue_count == 0)
+  {
+    return false;
+  }
+
+  std::swap(spectrum, queue[queue_head]);
+  queue_head = (queue_head + 1) % queue.size();
+  --queue_count;
+
+  return true;
+}
+
 void a2i::Spectrogram::drawGrid(
   cv::Mat& img, 
   const int type, 
@@ -191,7 +744,7 @@ void a2i::Spectrogram::drawGrid(
   const std::vector<unsigned int>& freqs, 
   const int number_of_db_risks,
   const cv::Scalar line_color, 
-  const cv::Scalar text_color) 
+  const cv::Scalar text_color) const
 {
   std::vector<unsigned int> freq_risks;
 
@@ -222,9 +775,7 @@ void a2i::Spectrogram::drawGrid(
 
   for(int i = 1; i < freq_size; i++)
   {
-    x = type ? 
-      std::max(0., ((std::log2(freq_risks[i]) - std::log2(freq_risks[0])) / (std::log2(freq_range.second) - std::log2(freq_risks[0]))) * img.cols)
-    : std::max(0., static_cast<double>(freq_risks[i] - freq_risks[0])) * img.cols * 2 / sample_rate;
+    x = gridPosition(freq_risks[i], type, freq_risks[0]) * img.cols;
 
     cv::line(img, cv::Point(x, 0), cv::Point(x, img.rows), line_color, 1);
 
@@ -252,121 +803,323 @@ void a2i::Spectrogram::drawGrid(
   }
 }
 
+double a2i::Spectrogram::gridPosition(double freq, const int type, const unsigned int origin) const
+{
+  if(type)
+  {
+    return std::max(0., (std::log2(freq) - std::log2(origin)) / (std::log2(freq_range.second) - std::log2(origin)));
+  }
+
+  return std::max(0., freq - origin) * 2 / sample_rate;
+}
+
+double a2i::Spectrogram::gridFreq(double position, const int type, const unsigned int origin) const
+{
+  if(type)
+  {
+    return std::exp2(std::log2(origin) + position * (std::log2(freq_range.second) - std::log2(origin)));
+  }
+
+  return origin + position * sample_rate / 2;
+}
+
 double a2i::Spectrogram::interpolate(double from ,double to ,float percent) 
 {
   double difference = to - from;
   return from + ( difference * percent );
 }
 
-void a2i::Spectrogram::drawGraientLine(
+void a2i::Spectrogram::markColumn(cv::Mat& img, const int x, const int y)
+{
+  if(x >= 0 && x < img.cols)
+  {
+    column_top[x] = std::min(column_top[x], static_cast<uint16_t>(std::clamp(y, 0, img.rows)));
+  }
+}
+
+void a2i::Spectrogram::fillColumns(
   cv::Mat& img,
   const int fill_type, 
-  const cv::Point& first_point, 
-  const cv::Point& second_point, 
   const cv::Scalar underline_color,
-  const int gradient_color)
+  const int gradient_coefficient)
 {
-  switch(fill_type)
+  if(fill_type == NOT_FILLED)
+  {
+    return;
+  }
+
+  if(gradient_lut.size() != static_cast<size_t>(img.rows + 1) || gradient_lut_coefficient != gradient_coefficient)
   {
-    case NOT_FILLED :
+    gradient_lut.resize(img.rows + 1);
+    for(int y = 0; y <= img.rows; ++y)
     {
-      break;
+      gradient_lut[y] = cv::saturate_cast<uchar>(static_cast<int>((1 - y / static_cast<double>(img.rows)) * gradient_coefficient));
     }
+    gradient_lut_coefficient = gradient_coefficient;
+  }
+
+  const uchar color[3] = {
+    cv::saturate_cast<uchar>(underline_color[0]), 
+    cv::saturate_cast<uchar>(underline_color[1]), 
+    cv::saturate_cast<uchar>(underline_color[2])};
+
+  // expand to one entry per channel so the row loop is a plain byte select
+  const int width = img.cols * 3;
+  fill_top.resize(width);
+  fill_color.resize(width);
 
-    case ONE_COLOR :
+  int first_row = img.rows;
+  for(int x = 0; x < img.cols; ++x)
+  {
+    const uint16_t top = column_top[x];
+    first_row = std::min<int>(first_row, top);
+
+    for(int c = 0; c < 3; ++c)
     {
-      cv::line(img, first_point, second_point, underline_color, 1);
-      break;
+      fill_top[x * 3 + c] = top;
+      fill_color[x * 3 + c] = fill_type == GRADIENT ? gradient_lut[top] : color[c];
     }
+  }
+
+  const uint16_t* __restrict top = fill_top.data();
+  const uchar* __restrict src = fill_color.data();
+
+  for(int y = first_row; y < img.rows; ++y)
+  {
+    uchar* __restrict row = img.ptr<uchar>(y);
+    const uint16_t row_index = static_cast<uint16_t>(y);
 
-    case GRADIENT :
+    for(int i = 0; i < width; ++i)
     {
-      cv::line(img, first_point, second_point, cv::Scalar(gradient_color, gradient_color, gradient_color), 1);
-      break;
+      row[i] = top[i] <= row_index ? src[i] : row[i];
     }
+  }
+}
 
-    default :
-    {
-      cv::line(img, first_point, second_point, underline_color, 1);
-      break;
-    } 
+bool a2i::Spectrogram::isValid(const BinMap& map, const int length, const int graph_mode, const unsigned int origin) const
+{
+  return map.frame_size == frame_size && map.sample_rate == sample_rate 
+    && map.freq_range == freq_range && map.length == length && map.graph_mode == graph_mode
+    && map.origin == origin;
+}
+
+double a2i::Spectrogram::freqToPosition(double freq, const int graph_mode) const
+{
+  if(graph_mode == LIN)
+  {
+    return (freq - freq_range.first) / (static_cast<double>(freq_range.second) - freq_range.first);
   }
+
+  const double log_first = std::log2(std::max(1u, freq_range.first));
+  return (std::log2(freq) - log_first) / (std::log2(freq_range.second) - log_first);
 }
 
-void a2i::Spectrogram::drawSpectrum(
-  cv::Mat& img, 
-  const int line_type, 
-  const int graph_mode, 
-  const int fill_type,
-  const bool border_line,
-  const cv::Scalar line_color, 
-  const cv::Scalar underline_color,
-  const int gradient_coefficient) 
+const a2i::Spectrogram::BinMap& a2i::Spectrogram::getSpectrumMap(const int width, const int graph_mode)
 {
-  int y_first;
-  double x_first = 0.0;
-  bool first_point = true;
+  if(isValid(spectrum_map, width, graph_mode))
+  {
+    return spectrum_map;
+  }
+
+  spectrum_map = {frame_size, sample_rate, freq_range, width, graph_mode, 0, {}};
+  auto& groups = spectrum_map.groups;
 
-  std::vector<cv::Point> control_points;
-  for(size_t i = 0; i < frame_size / 2; i += 1) 
+  const unsigned int bins = frame_size / 2;
+  unsigned int lead = bins;
+  unsigned int trail = bins;
+
+  // log2(0) has no position, so DC is always a lead bin on a log axis
+  const unsigned int first_freq = graph_mode == LIN ? freq_range.first : std::max(1u, freq_range.first);
+
+  for(unsigned int i = 0; i < bins; ++i)
   {
-    double x;
-    int y;
     double freq = i * static_cast<double>(sample_rate) / frame_size;
-    
-    switch(graph_mode)
+
+    if(freq < first_freq)
     {
-      case LIN :
-      {
-        x = std::min(static_cast<double>(img.cols), 
-            std::max(0., (freq - freq_range.first) * img.cols / (freq_range.second - freq_range.first)));
-        break;
-      }
+      lead = i;
+    }
+    else if(freq <= freq_range.second)
+    {
+      int x = std::clamp(static_cast<int>(std::lround(freqToPosition(freq, graph_mode) * width)), 0, width);
 
-      case LOG :
+      if(!groups.empty() && groups.back().x == x)
       {
-        x = std::min(static_cast<double>(img.cols), 
-            std::max(0., (std::log2(freq) - std::log2(freq_range.first))  * img.cols / (std::log2(freq_range.second) - std::log2(freq_range.first))));
-        break;
+        groups.back().last = i + 1;
       }
-
-      default :
+      else
       {
-        x = std::min(static_cast<double>(img.cols), 
-            std::max(0., (std::log2(freq) - std::log2(freq_range.first))  * img.cols / (std::log2(freq_range.second) - std::log2(freq_range.first))));
-        break;
+        groups.push_back({x, i, i + 1});
       }
     }
+    else
+    {
+      trail = i;
+      break;
+    }
+  }
+
+  if(groups.empty())
+  {
+    return spectrum_map;
+  }
+
+  // the curve starts at the left border with the last bin below the range
+  // and ends at the right border with everything above it
+  if(lead == bins)
+  {
+    lead = groups.front().first;
+  }
+
+  groups.insert(groups.begin(), {0, lead, lead + 1});
+
+  if(trail < bins)
+  {
+    groups.push_back({width, trail, bins});
+  }
+
+  return spectrum_map;
+}
+
+const a2i::Spectrogram::BinMap& a2i::Spectrogram::getPixelMap(
+  BinMap& map, 
+  const int length, 
+  const int graph_mode, 
+  const bool bottom_up,
+  const unsigned int origin)
+{
+  if(isValid(map, length, graph_mode, origin))
+  {
+    return map;
+  }
+
+  map = {frame_size, sample_rate, freq_range, length, graph_mode, origin, {}};
+
+  const double bins_per_hz = static_cast<double>(frame_size) / sample_rate;
+  const unsigned int bins = frame_size / 2;
+
+  auto positionFreq = [&](double position)
+  {
+    if(origin)
+    {
+      return gridFreq(position, graph_mode, origin);
+    }
 
-    if(out[i] < 0) 
+    if(graph_mode == LIN)
     {
-      y = (1 - (std::abs(db_range.first - out[i]) / std::abs(db_range.second - db_range.first))) * img.rows;
+      return freq_range.first + position * (static_cast<double>(freq_range.second) - freq_range.first);
     }
-    else 
+
+    const double log_first = std::log2(std::max(1u, freq_range.first));
+    return std::exp2(log_first + position * (std::log2(freq_range.second) - log_first));
+  };
+
+  // every pixel covers at least one bin, low frequencies at the bottom of
+  // a column and on the left of a row
+  for(int i = 0; i < length; ++i)
+  {
+    double position = static_cast<double>(bottom_up ? length - 1 - i : i) / length;
+
+    unsigned int first = static_cast<unsigned int>(positionFreq(position) * bins_per_hz);
+    unsigned int last = static_cast<unsigned int>(std::ceil(positionFreq(position + 1.0 / length) * bins_per_hz));
+    first = std::min(first, bins - 1);
+    last = std::clamp(last, first + 1, bins);
+
+    map.groups.push_back({i, first, last});
+  }
+
+  return map;
+}
+
+float a2i::Spectrogram::aggregate(const Spectrum& spectrum, const BinGroup& group) const
+{
+  auto first = spectrum.begin() + group.first;
+  auto last = spectrum.begin() + group.last;
+
+  if(group.last - group.first == 1)
+  {
+    return *first;
+  }
+
+  switch(bin_aggregation)
+  {
+    case AGGREGATE_MEAN :
     {
-      y = (1 - ((std::abs(db_range.first) + out[i]) / std::abs(db_range.second - db_range.first))) * img.rows;
+      return std::accumulate(first, last, 0.0f) / (group.last - group.first);
     }
 
-    if(freq >= freq_range.first && freq <= freq_range.second)
+    case AGGREGATE_RMS :
     {
-      if(first_point)
+      // mean of the linear power, back in dB
+      const double multiplier = db_multiplier.load(std::memory_order_relaxed);
+      double power = 0;
+      for(auto it = first; it != last; ++it)
       {
-        control_points.push_back(cv::Point(x_first, y_first));
-        first_point = false;
+        power += std::pow(10.0, *it / multiplier);
       }
-      control_points.push_back(cv::Point(x, y));
-      
+      return multiplier * std::log10(power / (group.last - group.first));
     }
-    else
-    { 
-      y_first = y;
 
-      if(!first_point)
-      {
-        control_points.push_back(cv::Point(img.cols, y));
-      }
+    default :
+    {
+      return *std::max_element(first, last);
     }
   }
+}
+
+int a2i::Spectrogram::dbToY(float db, int rows) const
+{
+  if(db < 0) 
+  {
+    return (1 - (std::abs(db_range.first - db) / std::abs(db_range.second - db_range.first))) * rows;
+  }
+
+  return (1 - ((std::abs(db_range.first) + db) / std::abs(db_range.second - db_range.first))) * rows;
+}
+
+void a2i::Spectrogram::drawSpectrum(
+  cv::Mat& img, 
+  const int line_type, 
+  const int graph_mode, 
+  const int fill_type,
+  const bool border_line,
+  const cv::Scalar line_color, 
+  const cv::Scalar underline_color,
+  const int gradient_coefficient) 
+{
+  drawSpectrum(img, out, line_type, graph_mode, fill_type, border_line, line_color, underline_color, gradient_coefficient);
+}
+
+void a2i::Spectrogram::drawSpectrum(
+  cv::Mat& img, 
+  const Spectrum& spectrum,
+  const int line_type, 
+  const int graph_mode, 
+  const int fill_type,
+  const bool border_line,
+  const cv::Scalar line_color, 
+  const cv::Scalar underline_color,
+  const int gradient_coefficient) 
+{
+  A2I_PROFILE_SCOPE(STAGE_DRAW);
+
+  const BinMap& map = getSpectrumMap(img.cols, graph_mode);
+
+  control_points.clear();
+  for(const auto& group : map.groups)
+  {
+    control_points.push_back(cv::Point(group.x, dbToY(aggregate(spectrum, group), img.rows)));
+  }
+
+  if(control_points.size() < 2)
+  {
+    return;
+  }
+
+  // every fill type only extends columns down to the bottom, so the fill
+  // is collected as the topmost row per column and rasterized in one pass
+  column_top.assign(img.cols, static_cast<uint16_t>(img.rows));
+  border_points.clear();
 
   switch(line_type)
   {
@@ -405,14 +1158,21 @@ void a2i::Spectrogram::drawSpectrum(
 
           if(border_line)
           {
-            img.at<cv::Vec3b>(cv::Point(x, y)) = cv::Vec3b(line_color[0], line_color[1], line_color[2]);
+            border_points.push_back(cv::Point(static_cast<int>(x), static_cast<int>(y)));
           }
 
-          int gradient_color = static_cast<int>((1 - y / static_cast<double>(img.rows)) * gradient_coefficient);
-          drawGraientLine(img, fill_type, cv::Point(x, y), cv::Point(x, img.rows), underline_color, gradient_color);
+          markColumn(img, static_cast<int>(x), static_cast<int>(y));
         }
       }
 
+      fillColumns(img, fill_type, underline_color, gradient_coefficient);
+
+      const cv::Vec3b border_color(line_color[0], line_color[1], line_color[2]);
+      for(const auto& point : border_points)
+      {
+        img.at<cv::Vec3b>(point) = border_color;
+      }
+
       break;
     }
 
@@ -420,26 +1180,24 @@ void a2i::Spectrogram::drawSpectrum(
     {
       for(size_t i = 0; i < control_points.size() - 1; i+=1)
       {
-        cv::Point vertices[4];
-        vertices[0] = control_points[i];
-        vertices[1] = control_points[i+1];
-        vertices[2] = cv::Point(control_points[i+1].x, img.rows);
-        vertices[3] = cv::Point(control_points[i].x, img.rows);
+        const cv::Point& first = control_points[i];
+        const cv::Point& second = control_points[i+1];
 
-        for (int x = vertices[0].x; x < vertices[1].x; x++)
+        for (int x = first.x; x < second.x; x++)
         {
-          double t = (double)(x - vertices[0].x) / (vertices[1].x - vertices[0].x);
-          int y = interpolate(vertices[0].y, vertices[1].y, t);
-          int gradient_color = static_cast<int>((1 - y / static_cast<double>(img.rows)) * gradient_coefficient);
-          drawGraientLine(img, fill_type, cv::Point(x, y), cv::Point(x, img.rows), underline_color, gradient_color);
+          double t = (double)(x - first.x) / (second.x - first.x);
+          markColumn(img, x, interpolate(first.y, second.y, t));
         }
+      }
 
-        if(border_line)
+      fillColumns(img, fill_type, underline_color, gradient_coefficient);
+
+      if(border_line)
+      {
+        for(size_t i = 0; i < control_points.size() - 1; i+=1)
         {
           cv::line(img, control_points[i], control_points[i+1], line_color, 1);
         }
-        
-
       }
 
       break;
@@ -449,11 +1207,47 @@ void a2i::Spectrogram::drawSpectrum(
     {
       for(size_t i = 0; i < control_points.size(); i+=1) 
       {
-        int gradient_color = static_cast<int>((1 - control_points[i].y / static_cast<double>(img.rows)) * gradient_coefficient);
-        drawGraientLine(img, fill_type, cv::Point(control_points[i].x, control_points[i].y), cv::Point(control_points[i].x, img.rows), underline_color, gradient_color);
+        markColumn(img, control_points[i].x, control_points[i].y);
       }
 
+      fillColumns(img, fill_type, underline_color, gradient_coefficient);
       break;
     }
   }
-}
\ No newline at end of file
+}
+
+void a2i::Spectrogram::drawColumn(
+  cv::Mat& img, 
+  const int x, 
+  const Spectrum& spectrum, 
+  const int graph_mode)
+{
+  const BinMap& map = getPixelMap(column_map, img.rows, graph_mode, true);
+  const double db_span = db_range.second - db_range.first;
+
+  for(const auto& group : map.groups)
+  {
+    double value = std::clamp((aggregate(spectrum, group) - db_range.first) / db_span, 0.0, 1.0);
+    img.at<uchar>(group.x, x) = static_cast<uchar>(value * 255);
+  }
+}
+
+void a2i::Spectrogram::drawRow(
+  cv::Mat& img, 
+  const int y, 
+  const Spectrum& spectrum, 
+  const int graph_mode,
+  const std::vector<unsigned int>& freqs)
+{
+  // 20 Hz leads drawGrid()'s default risks
+  const unsigned int origin = std::max(1u, freqs.empty() ? 20u : freqs[0]);
+  const BinMap& map = getPixelMap(row_map, img.cols, graph_mode, false, origin);
+  const double db_span = db_range.second - db_range.first;
+  uchar* row = img.ptr<uchar>(y);
+
+  for(const auto& group : map.groups)
+  {
+    double value = std::clamp((aggregate(spectrum, group) - db_range.first) / db_span, 0.0, 1.0);
+    row[group.x] = static_cast<uchar>(value * 255);
+  }
+}
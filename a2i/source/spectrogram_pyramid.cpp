@@ -0,0 +1,207 @@
+#include "spectrogram_pyramid.hpp"
+
+#include <stdio.h>
+#include <math.h>
+#include <algorithm>
+#include <filesystem>
+#include <system_error>
+
+std::string a2i::pyramidLevelPath(const std::string& dir, size_t level)
+{
+  char name[32];
+  snprintf(name, sizeof(name), "level_%02zu.a2is", level);
+  return (std::filesystem::path(dir) / name).string();
+}
+
+a2i::PyramidWriter::~PyramidWriter()
+{
+  close();
+}
+
+bool a2i::PyramidWriter::open(
+  const std::string& dir,
+  const StftHeader& base,
+  const int pooling,
+  const unsigned int max_levels)
+{
+  close();
+
+  std::error_code error;
+  std::filesystem::create_directories(dir, error);
+  if(error)
+  {
+    return false;
+  }
+
+  directory = dir;
+  base_header = base;
+  base_header.format = UINT8;
+  pooling_mode = pooling;
+  level_limit = std::max(1u, max_levels);
+
+  return addLevel();
+}
+
+bool a2i::PyramidWriter::addLevel()
+{
+  const size_t level = pyramid.size();
+
+  StftHeader header = base_header;
+  header.hop_size = base_header.hop_size << level;
+
+  auto next = std::make_unique<Level>();
+  next->pending.resize(header.bins);
+
+  if(!next->writer.open(pyramidLevelPath(directory, level), header))
+  {
+    level_limit = level;
+    return false;
+  }
+
+  pyramid.push_back(std::move(next));
+  return true;
+}
+
+void a2i::PyramidWriter::append(const float* column)
+{
+  if(!pyramid.empty())
+  {
+    push(0, column);
+  }
+}
+
+void a2i::PyramidWriter::push(size_t level, const float* column)
+{
+  Level& current = *pyramid[level];
+  current.writer.append(column);
+
+  if(level + 1 >= level_limit)
+  {
+    return;
+  }
+
+  if(!current.has_pending)
+  {
+    std::copy_n(column, current.pending.size(), current.pending.begin());
+    current.has_pending = true;
+    return;
+  }
+
+  // both halves cover the same number of columns, so the mean of means is exact
+  for(size_t i = 0; i < current.pending.size(); ++i)
+  {
+    current.pending[i] = pooling_mode == POOL_MEAN ?
+      0.5f * (current.pending[i] + column[i])
+    : std::max(current.pending[i], column[i]);
+  }
+  current.has_pending = false;
+
+  if(level + 1 == pyramid.size() && !addLevel())
+  {
+    return;
+  }
+
+  push(level + 1, current.pending.data());
+}
+
+void a2i::PyramidWriter::flush()
+{
+  for(auto& level : pyramid)
+  {
+    level->writer.flush();
+  }
+}
+
+void a2i::PyramidWriter::close()
+{
+  // a trailing odd column is carried up on its own, so every level covers
+  // the whole stream; a level with a single column is already the top
+  for(size_t level = 0; level + 1 < pyramid.size(); ++level)
+  {
+    Level& current = *pyramid[level];
+    if(current.has_pending)
+    {
+      current.has_pending = false;
+      push(level + 1, current.pending.data());
+    }
+  }
+
+  for(auto& level : pyramid)
+  {
+    level->writer.close();
+  }
+
+  pyramid.clear();
+}
+
+size_t a2i::PyramidWriter::levels() const
+{
+  return pyramid.size();
+}
+
+bool a2i::PyramidReader::open(const std::string& dir)
+{
+  close();
+  directory = dir;
+  return refresh();
+}
+
+bool a2i::PyramidReader::refresh()
+{
+  for(auto& level : pyramid)
+  {
+    level->refresh();
+  }
+
+  while(true)
+  {
+    auto next = std::make_unique<StftReader>();
+    if(!next->open(pyramidLevelPath(directory, pyramid.size())))
+    {
+      break;
+    }
+
+    pyramid.push_back(std::move(next));
+  }
+
+  return !pyramid.empty();
+}
+
+void a2i::PyramidReader::close()
+{
+  pyramid.clear();
+}
+
+size_t a2i::PyramidReader::levels() const
+{
+  return pyramid.size();
+}
+
+const a2i::StftHeader& a2i::PyramidReader::header() const
+{
+  return pyramid.front()->header();
+}
+
+uint64_t a2i::PyramidReader::columns(size_t level) const
+{
+  return level < pyramid.size() ? pyramid[level]->frames() : 0;
+}
+
+size_t a2i::PyramidReader::levelFor(double columns_per_pixel) const
+{
+  // the coarsest level that still has at least one column per pixel
+  size_t level = columns_per_pixel > 1 ? static_cast<size_t>(std::floor(std::log2(columns_per_pixel))) : 0;
+  level = std::min(level, pyramid.size() - 1);
+
+  while(level > 0 && columns(level) == 0)
+  {
+    --level;
+  }
+
+  return level;
+}
+
+void a2i::PyramidReader::column(size_t level, uint64_t index, float* dst) const
+{
+  pyramid[level]->frame(index, dst);
+}
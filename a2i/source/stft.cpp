@@ -0,0 +1,85 @@
+#include "stft.hpp"
+
+#include <atomic>
+#include <thread>
+
+
+a2i::Stft::Stft(const Spectrogram& prototype, unsigned int threads) :
+  frame_size(prototype.getFrameSize()),
+  hop_size(prototype.getHopSize())
+{
+  if(threads == 0)
+  {
+    threads = std::max(1u, std::thread::hardware_concurrency());
+  }
+
+  for(unsigned int i = 0; i < threads; ++i)
+  {
+    workers.push_back(std::make_unique<Spectrogram>(prototype));
+  }
+}
+
+size_t a2i::Stft::frames(size_t samples) const
+{
+  return samples >= frame_size ? (samples - frame_size) / hop_size + 1 : 0;
+}
+
+unsigned int a2i::Stft::threads() const
+{
+  return workers.size();
+}
+
+void a2i::Stft::run(
+  const float* samples, 
+  size_t n, 
+  const frameCallback& callback, 
+  const int multiplier)
+{
+  const size_t total = frames(n);
+  std::atomic<size_t> next_block{0};
+
+  auto work = [&](Spectrogram& worker)
+  {
+    for(size_t first = next_block.fetch_add(block_size); first < total; first = next_block.fetch_add(block_size))
+    {
+      // flux is measured against the previous frame, which belongs to another block
+      if(first > 0 && worker.getFeaturesEnabled())
+      {
+        worker.addWindow(samples + (first - 1) * hop_size);
+        worker.fft();
+        worker.normalize(multiplier);
+      }
+
+      for(size_t frame = first; frame < std::min(first + block_size, total); ++frame)
+      {
+        worker.addWindow(samples + frame * hop_size);
+        worker.fft();
+        worker.normalize(multiplier);
+        callback(frame, worker);
+      }
+    }
+  };
+
+  std::vector<std::jthread> pool;
+  for(size_t i = 1; i < workers.size(); ++i)
+  {
+    pool.emplace_back(work, std::ref(*workers[i]));
+  }
+
+  work(*workers[0]);
+}
+
+void a2i::Stft::run(
+  const float* samples, 
+  size_t n, 
+  std::vector<float>& out, 
+  const int multiplier)
+{
+  const size_t bins = frame_size / 2;
+  out.resize(frames(n) * bins);
+
+  run(samples, n, [&](size_t frame, Spectrogram& worker)
+  {
+    std::copy(worker.out.begin(), worker.out.end(), out.begin() + frame * bins);
+  }, multiplier);
+}
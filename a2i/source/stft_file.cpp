@@ -0,0 +1,392 @@
+#include "stft_file.hpp"
+
+#include <string.h>
+#include <stddef.h>
+#include <math.h>
+#include <algorithm>
+#include <bit>
+#include <filesystem>
+#include <limits>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+// headers and values are written in host order and the format is little-endian
+static_assert(std::endian::native == std::endian::little, "the .a2is format is little-endian");
+
+namespace
+{
+  bool seek(FILE* file, uint64_t offset)
+  {
+#ifdef _WIN32
+    return _fseeki64(file, static_cast<__int64>(offset), SEEK_SET) == 0;
+#else
+    return fseeko(file, static_cast<off_t>(offset), SEEK_SET) == 0;
+#endif
+  }
+
+  template<typename T>
+  void quantize(const float* src, T* dst, size_t n, float db_min, float db_max)
+  {
+    const float scale = std::numeric_limits<T>::max() / (db_max - db_min);
+
+    for(size_t i = 0; i < n; ++i)
+    {
+      float value = std::clamp((src[i] - db_min) * scale, 0.0f, static_cast<float>(std::numeric_limits<T>::max()));
+      dst[i] = static_cast<T>(value + 0.5f);
+    }
+  }
+
+  template<typename T>
+  void dequantize(const T* src, float* dst, size_t n, float db_min, float db_max)
+  {
+    const float scale = (db_max - db_min) / std::numeric_limits<T>::max();
+
+    for(size_t i = 0; i < n; ++i)
+    {
+      dst[i] = db_min + src[i] * scale;
+    }
+  }
+}
+
+a2i::StftHeader a2i::makeStftHeader(const Spectrogram& spectrogram, const int format)
+{
+  StftHeader header;
+  header.sample_rate = spectrogram.getSampleRate();
+  header.frame_size = spectrogram.getFrameSize();
+  header.hop_size = spectrogram.getHopSize();
+  header.window = spectrogram.getWindowFunc();
+  header.db_min = spectrogram.getDbRange().first;
+  header.db_max = spectrogram.getDbRange().second;
+  header.bins = spectrogram.getFilterbank() ? spectrogram.bands.size() : spectrogram.out.size();
+  header.scale = spectrogram.getFilterbank() ? spectrogram.getFilterbank()->getScale() + 1 : 0;
+  header.format = format;
+  return header;
+}
+
+size_t a2i::stftValueSize(const int format)
+{
+  switch(format)
+  {
+    case UINT8 :
+      return sizeof(uint8_t);
+    case UINT16 :
+      return sizeof(uint16_t);
+    default :
+      return sizeof(float);
+  }
+}
+
+a2i::StftWriter::~StftWriter()
+{
+  close();
+}
+
+bool a2i::StftWriter::open(const std::string& path, const StftHeader& file_header)
+{
+  close();
+
+  // quantized formats divide by the range, the negated test also rejects NaN
+  if(!(file_header.db_max > file_header.db_min))
+  {
+    return false;
+  }
+
+  file = fopen(path.c_str(), "wb+");
+  if(!file)
+  {
+    return false;
+  }
+
+  header = file_header;
+  header.frame_count = 0;
+  frame_bytes = header.bins * stftValueSize(header.format);
+  buffer.resize(frame_bytes);
+
+  // flushed so a full disk is reported here and not at the first frame
+  if(fwrite(&header, sizeof(header), 1, file) != 1 || fflush(file) != 0)
+  {
+    fclose(file);
+    file = nullptr;
+    return false;
+  }
+
+  return true;
+}
+
+void a2i::StftWriter::encode(const float* frame, std::vector<uint8_t>& dst) const
+{
+  switch(header.format)
+  {
+    case UINT8 :
+    {
+      quantize(frame, dst.data(), header.bins, header.db_min, header.db_max);
+      break;
+    }
+
+    case UINT16 :
+    {
+      quantize(frame, reinterpret_cast<uint16_t*>(dst.data()), header.bins, header.db_min, header.db_max);
+      break;
+    }
+
+    default :
+    {
+      memcpy(dst.data(), frame, frame_bytes);
+      break;
+    }
+  }
+}
+
+bool a2i::StftWriter::append(const float* frame)
+{
+  std::lock_guard<std::mutex> lock(mutex);
+
+  if(!file)
+  {
+    return false;
+  }
+
+  encode(frame, buffer);
+  if(fwrite(buffer.data(), frame_bytes, 1, file) != 1)
+  {
+    return false;
+  }
+
+  ++header.frame_count;
+  return true;
+}
+
+bool a2i::StftWriter::write(uint64_t index, const float* frame)
+{
+  // frames may arrive out of order from several threads
+  thread_local std::vector<uint8_t> encoded;
+  encoded.resize(frame_bytes);
+  encode(frame, encoded);
+
+  std::lock_guard<std::mutex> lock(mutex);
+
+  if(!file)
+  {
+    return false;
+  }
+
+  bool written = seek(file, sizeof(StftHeader) + index * frame_bytes)
+    && fwrite(encoded.data(), frame_bytes, 1, file) == 1;
+  if(written)
+  {
+    header.frame_count = std::max(header.frame_count, index + 1);
+  }
+
+  seek(file, sizeof(StftHeader) + header.frame_count * frame_bytes);
+  return written;
+}
+
+void a2i::StftWriter::flush()
+{
+  std::lock_guard<std::mutex> lock(mutex);
+
+  if(!file)
+  {
+    return;
+  }
+
+  fflush(file);
+  seek(file, offsetof(StftHeader, frame_count));
+  fwrite(&header.frame_count, sizeof(header.frame_count), 1, file);
+  seek(file, sizeof(StftHeader) + header.frame_count * frame_bytes);
+  fflush(file);
+}
+
+void a2i::StftWriter::close()
+{
+  if(!file)
+  {
+    return;
+  }
+
+  flush();
+  fclose(file);
+  file = nullptr;
+}
+
+uint64_t a2i::StftWriter::frames() const
+{
+  std::lock_guard<std::mutex> lock(mutex);
+  return header.frame_count;
+}
+
+a2i::StftReader::~StftReader()
+{
+  close();
+}
+
+bool a2i::StftReader::open(const std::string& file_path)
+{
+  close();
+  path = file_path;
+  return map();
+}
+
+bool a2i::StftReader::refresh()
+{
+  if(mapping && !changed())
+  {
+    return true;
+  }
+
+  unmap();
+  return map();
+}
+
+bool a2i::StftReader::changed() const
+{
+  std::error_code error;
+  const uintmax_t size = std::filesystem::file_size(path, error);
+  if(error || size != stat_size)
+  {
+    return true;
+  }
+
+  // flush() rewrites frame_count in place, the shared mapping sees it
+  uint64_t frame_count;
+  memcpy(&frame_count, mapping + offsetof(StftHeader, frame_count), sizeof(frame_count));
+  return frame_count != file_header.frame_count;
+}
+
+void a2i::StftReader::close()
+{
+  unmap();
+  path.clear();
+}
+
+bool a2i::StftReader::map()
+{
+  // taken before mapping, so a write in between is picked up by the next refresh()
+  std::error_code error;
+  stat_size = std::filesystem::file_size(path, error);
+
+#ifdef _WIN32
+  file_handle = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, 
+    nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+  if(file_handle == INVALID_HANDLE_VALUE)
+  {
+    file_handle = nullptr;
+    return false;
+  }
+
+  LARGE_INTEGER size;
+  if(!GetFileSizeEx(file_handle, &size) || size.QuadPart < static_cast<LONGLONG>(sizeof(StftHeader)))
+  {
+    unmap();
+    return false;
+  }
+
+  map_handle = CreateFileMappingA(file_handle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+  mapping = map_handle ? static_cast<const uint8_t*>(MapViewOfFile(map_handle, FILE_MAP_READ, 0, 0, 0)) : nullptr;
+  mapping_size = static_cast<size_t>(size.QuadPart);
+#else
+  fd = ::open(path.c_str(), O_RDONLY);
+  if(fd < 0)
+  {
+    return false;
+  }
+
+  struct stat st;
+  if(fstat(fd, &st) != 0 || st.st_size < static_cast<off_t>(sizeof(StftHeader)))
+  {
+    unmap();
+    return false;
+  }
+
+  void* ptr = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  mapping = ptr == MAP_FAILED ? nullptr : static_cast<const uint8_t*>(ptr);
+  mapping_size = st.st_size;
+#endif
+
+  if(!mapping)
+  {
+    unmap();
+    return false;
+  }
+
+  memcpy(&file_header, mapping, sizeof(file_header));
+  if(memcmp(file_header.magic, "A2IS", 4) != 0 || file_header.version < 1 || file_header.version > stft_file_version)
+  {
+    unmap();
+    return false;
+  }
+
+  frame_bytes = file_header.bins * stftValueSize(file_header.format);
+  return true;
+}
+
+void a2i::StftReader::unmap()
+{
+#ifdef _WIN32
+  if(mapping) UnmapViewOfFile(mapping);
+  if(map_handle) CloseHandle(map_handle);
+  if(file_handle) CloseHandle(file_handle);
+  map_handle = nullptr;
+  file_handle = nullptr;
+#else
+  if(mapping) munmap(const_cast<uint8_t*>(mapping), mapping_size);
+  if(fd >= 0) ::close(fd);
+  fd = -1;
+#endif
+
+  mapping = nullptr;
+  mapping_size = 0;
+}
+
+const a2i::StftHeader& a2i::StftReader::header() const
+{
+  return file_header;
+}
+
+uint64_t a2i::StftReader::frames() const
+{
+  if(!mapping || frame_bytes == 0)
+  {
+    return 0;
+  }
+
+  return std::min<uint64_t>(file_header.frame_count, (mapping_size - sizeof(StftHeader)) / frame_bytes);
+}
+
+const void* a2i::StftReader::data(uint64_t index) const
+{
+  return mapping + sizeof(StftHeader) + index * frame_bytes;
+}
+
+void a2i::StftReader::frame(uint64_t index, float* dst) const
+{
+  const void* src = data(index);
+
+  switch(file_header.format)
+  {
+    case UINT8 :
+    {
+      dequantize(static_cast<const uint8_t*>(src), dst, file_header.bins, file_header.db_min, file_header.db_max);
+      break;
+    }
+
+    case UINT16 :
+    {
+      dequantize(static_cast<const uint16_t*>(src), dst, file_header.bins, file_header.db_min, file_header.db_max);
+      break;
+    }
+
+    default :
+    {
+      memcpy(dst, src, frame_bytes);
+      break;
+    }
+  }
+}
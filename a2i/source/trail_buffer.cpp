@@ -0,0 +1,56 @@
+#include "trail_buffer.hpp"
+
+#include <algorithm>
+#include <math.h>
+
+
+a2i::TrailBuffer::TrailBuffer(int frames)
+{
+  setFrames(frames);
+}
+
+void a2i::TrailBuffer::setFrames(int n)
+{
+  frames = std::max(n, 0);
+
+  // d^(n-1) = 1/n, so the oldest of the n frames keeps 1/n of the weight
+  double d = frames > 1 ? pow(frames, -1.0 / (frames - 1)) : 0.0;
+  decay = std::min<uint32_t>(static_cast<uint32_t>(lround(d * 65536)), 65535);
+  gain = frames ? 77 : 0;  // 0.3
+
+  clear();
+}
+
+int a2i::TrailBuffer::getFrames() const
+{
+  return frames;
+}
+
+void a2i::TrailBuffer::clear()
+{
+  std::fill(history.begin(), history.end(), 0);
+}
+
+void a2i::TrailBuffer::compose(cv::Mat& img, const cv::Mat& layer)
+{
+  const int width = img.cols * img.channels();
+
+  if(history.size() != static_cast<size_t>(img.rows) * width)
+  {
+    history.assign(static_cast<size_t>(img.rows) * width, 0);
+  }
+
+  for(int y = 0; y < img.rows; ++y)
+  {
+    uchar* __restrict dst = img.ptr<uchar>(y);
+    const uchar* __restrict src = layer.ptr<uchar>(y);
+    uint16_t* __restrict acc = history.data() + static_cast<size_t>(y) * width;
+
+    for(int i = 0; i < width; ++i)
+    {
+      const uint32_t trail = acc[i];
+      dst[i] = static_cast<uchar>(std::min<uint32_t>(dst[i] + (trail >> 8) + src[i], 255));
+      acc[i] = static_cast<uint16_t>(std::min<uint32_t>(((trail * decay) >> 16) + src[i] * gain, 65535));
+    }
+  }
+}
@@ -0,0 +1,117 @@
+#include "waterfall.hpp"
+#include "render_context.hpp"
+#include "profiler.hpp"
+
+#include <algorithm>
+
+
+a2i::Waterfall::Waterfall(Spectrogram& spectrogram, int rows, int cols) : 
+  spectrogram(spectrogram),
+  axis(spectrogram)
+{
+  axis.setText(false);
+  axis.setDbRisks(0);
+  axis.setGraphMode(graph_mode);
+  resize(rows, cols);
+  setColormap(-1);
+}
+
+void a2i::Waterfall::resize(int rows, int cols)
+{
+  history.create(rows, cols, CV_8UC1);
+  colored.create(rows * 2, cols, CV_8UC3);
+  clear();
+}
+
+void a2i::Waterfall::clear()
+{
+  history.setTo(cv::Scalar(0));
+  head = 0;
+  recolor();
+}
+
+void a2i::Waterfall::setGraphMode(int mode)
+{
+  if(mode != graph_mode)
+  {
+    graph_mode = mode;
+    axis.setGraphMode(mode);
+    clear();
+  }
+}
+
+void a2i::Waterfall::setColormap(int colormap)
+{
+  palette = RenderContext::makePalette(colormap);
+  recolor();
+}
+
+void a2i::Waterfall::setGrid(const bool enabled, const cv::Scalar line_color)
+{
+  grid_enabled = enabled;
+  axis.setColors(line_color, line_color);
+  recolor();
+}
+
+void a2i::Waterfall::recolor()
+{
+  if(grid_enabled) axis.update(1, history.cols);
+
+  for(int y = 0; y < history.rows; ++y)
+  {
+    colorRow(y);
+  }
+}
+
+void a2i::Waterfall::colorRow(int y)
+{
+  if(palette.empty())
+  {
+    return;
+  }
+
+  const cv::Vec3b* colors = palette.ptr<cv::Vec3b>(0);
+  const uchar* __restrict src = history.ptr<uchar>(y);
+  cv::Vec3b* __restrict dst = colored.ptr<cv::Vec3b>(y);
+
+  for(int x = 0; x < history.cols; ++x)
+  {
+    dst[x] = colors[src[x]];
+  }
+
+  if(grid_enabled)
+  {
+    const uchar* __restrict line = axis.image().ptr<uchar>(0);
+    uchar* __restrict row = colored.ptr<uchar>(y);
+
+    for(int i = 0; i < history.cols * 3; ++i)
+    {
+      row[i] = static_cast<uchar>(std::min(row[i] + line[i], 255));
+    }
+  }
+
+  const uchar* row = colored.ptr<uchar>(y);
+  std::copy(row, row + history.cols * 3, colored.ptr<uchar>(y + history.rows));
+}
+
+void a2i::Waterfall::push(const Spectrum& spectrum)
+{
+  A2I_PROFILE_SCOPE(STAGE_DRAW);
+
+  // the sample rate or ranges moved the grid lines, redraw them on every row
+  if(grid_enabled && axis.update(1, history.cols))
+  {
+    recolor();
+  }
+
+  head = (head == 0 ? history.rows : head) - 1;
+  spectrogram.drawRow(history, head, spectrum, graph_mode);
+  colorRow(head);
+}
+
+const cv::Mat& a2i::Waterfall::render()
+{
+  // newest row on top, a view into the mirrored history
+  output = colored.rowRange(head, head + history.rows);
+  return output;
+}
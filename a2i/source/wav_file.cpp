@@ -0,0 +1,167 @@
+#include "wav_file.hpp"
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <algorithm>
+#include <bit>
+
+// fields and samples are read in host order and the format is little-endian
+static_assert(std::endian::native == std::endian::little, "WAVE files are little-endian");
+
+namespace
+{
+  constexpr uint16_t format_pcm = 1;
+  constexpr uint16_t format_float = 3;
+  constexpr uint16_t format_extensible = 0xFFFE;
+
+  template<typename T>
+  T field(const uint8_t* src)
+  {
+    T value;
+    memcpy(&value, src, sizeof(T));
+    return value;
+  }
+
+  template<typename T>
+  void convert(const uint8_t* src, float* dst, size_t samples, float scale)
+  {
+    for(size_t i = 0; i < samples; ++i)
+    {
+      dst[i] = field<T>(src + i * sizeof(T)) * scale;
+    }
+  }
+
+  bool decode(const uint8_t* src, float* dst, size_t samples, uint16_t format, uint16_t bits)
+  {
+    if(format == format_float && bits == 32)
+    {
+      convert<float>(src, dst, samples, 1.0f);
+    }
+    else if(format == format_float && bits == 64)
+    {
+      convert<double>(src, dst, samples, 1.0f);
+    }
+    else if(format != format_pcm)
+    {
+      return false;
+    }
+    else if(bits == 8)
+    {
+      // 8-bit PCM is the only unsigned width
+      for(size_t i = 0; i < samples; ++i)
+      {
+        dst[i] = (src[i] - 128) / 128.0f;
+      }
+    }
+    else if(bits == 16)
+    {
+      convert<int16_t>(src, dst, samples, 1.0f / 32768.0f);
+    }
+    else if(bits == 24)
+    {
+      for(size_t i = 0; i < samples; ++i)
+      {
+        const uint8_t* sample = src + i * 3;
+        const uint32_t value = sample[0] << 8 | sample[1] << 16 | static_cast<uint32_t>(sample[2]) << 24;
+        dst[i] = static_cast<int32_t>(value) / 2147483648.0f;
+      }
+    }
+    else if(bits == 32)
+    {
+      convert<int32_t>(src, dst, samples, 1.0f / 2147483648.0f);
+    }
+    else
+    {
+      return false;
+    }
+
+    return true;
+  }
+}
+
+bool a2i::loadWav(
+  const std::string& path, 
+  std::vector<float>& interleaved, 
+  unsigned int& sample_rate, 
+  unsigned int& channels)
+{
+  FILE* file = fopen(path.c_str(), "rb");
+  if(!file)
+  {
+    return false;
+  }
+
+  std::vector<uint8_t> bytes;
+  uint8_t chunk[1 << 16];
+  size_t n;
+  while((n = fread(chunk, 1, sizeof(chunk), file)) > 0)
+  {
+    bytes.insert(bytes.end(), chunk, chunk + n);
+  }
+
+  const bool failed = ferror(file);
+  fclose(file);
+
+  if(failed || bytes.size() < 12 || memcmp(bytes.data(), "RIFF", 4) != 0 || memcmp(bytes.data() + 8, "WAVE", 4) != 0)
+  {
+    return false;
+  }
+
+  uint16_t format = 0;
+  uint16_t file_channels = 0;
+  uint32_t file_sample_rate = 0;
+  uint16_t block_align = 0;
+  uint16_t bits = 0;
+  const uint8_t* data = nullptr;
+  size_t data_size = 0;
+
+  for(size_t offset = 12; offset + 8 <= bytes.size();)
+  {
+    const uint8_t* id = bytes.data() + offset;
+    const size_t size = field<uint32_t>(id + 4);
+    const size_t body = offset + 8;
+
+    if(memcmp(id, "fmt ", 4) == 0 && size >= 16 && body + size <= bytes.size())
+    {
+      format = field<uint16_t>(id + 8);
+      file_channels = field<uint16_t>(id + 10);
+      file_sample_rate = field<uint32_t>(id + 12);
+      block_align = field<uint16_t>(id + 20);
+      bits = field<uint16_t>(id + 22);
+
+      // the sub-format GUID starts with the plain format tag
+      if(format == format_extensible && size >= 40)
+      {
+        format = field<uint16_t>(id + 32);
+      }
+    }
+    else if(memcmp(id, "data", 4) == 0)
+    {
+      data = id + 8;
+      data_size = std::min(size, bytes.size() - body);
+      break;
+    }
+
+    // chunks are padded to an even size
+    offset = body + size + (size & 1);
+  }
+
+  if(!data || !file_channels || !file_sample_rate || !bits || bits % 8 || block_align != file_channels * bits / 8)
+  {
+    return false;
+  }
+
+  const size_t samples = data_size / block_align * file_channels;
+  interleaved.resize(samples);
+
+  if(!decode(data, interleaved.data(), samples, format, bits))
+  {
+    interleaved.clear();
+    return false;
+  }
+
+  sample_rate = file_sample_rate;
+  channels = file_channels;
+  return true;
+}
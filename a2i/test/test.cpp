@@ -0,0 +1,1076 @@
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include <filesystem>
+#include <functional>
+#include <limits>
+#include <random>
+#include <string>
+#include <thread>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#endif
+
+#include "dsp.hpp"
+#include "multi_channel_spectrogram.hpp"
+#include "pcm_reader.hpp"
+#include "profiler.hpp"
+#include "ring_buffer.hpp"
+#include "spectrogram.hpp"
+#include "spectrogram_pyramid.hpp"
+#include "stft.hpp"
+#include "stft_file.hpp"
+#include "wav_file.hpp"
+
+/**
+ * Self-contained checks for the parts of a2i that are easy to get subtly
+ * wrong: buffer wraparound, file formats and the parallel paths that must
+ * match their sequential counterparts bit for bit.
+ *
+ *   a2i_tests [--filter=<substring>]
+ *
+ * Exits with 1 if any check failed.
+ */
+
+namespace {
+
+  const unsigned int sample_rate = 44100;
+
+  int failures = 0;
+
+  void check(bool condition, const std::string& what)
+  {
+    if(!condition)
+    {
+      std::cerr << "  failed: " << what << '\n';
+      ++failures;
+    }
+  }
+
+  std::string tempPath(const std::string& name)
+  {
+    return (std::filesystem::temp_directory_path() / ("a2i_tests_" + name)).string();
+  }
+
+  std::vector<float> makeSignal(size_t n)
+  {
+    std::mt19937 rng(42);
+    std::normal_distribution<float> noise(0.0f, 0.05f);
+    std::vector<float> signal(n);
+
+    for(size_t i = 0; i < n; ++i)
+    {
+      double t = static_cast<double>(i) / sample_rate;
+      signal[i] = 0.5 * std::sin(2 * M_PI * 440 * t)
+                + 0.25 * std::sin(2 * M_PI * 3520 * t)
+                + noise(rng);
+    }
+
+    return signal;
+  }
+
+  void testRingBufferWraparound()
+  {
+    a2i::RingBuffer ring(10);
+    check(ring.capacity() == 16, "capacity rounds up to a power of two");
+    check(ring.size() == 0 && ring.written() == 0, "empty after construction");
+
+    // sample i holds the value i, chunks straddle the wrap point and one is
+    // longer than the whole capacity
+    uint64_t next = 0;
+    size_t mismatches = 0;
+    for(size_t chunk : {7, 5, 13, 1, 16, 40, 3, 15, 9})
+    {
+      std::vector<float> data(chunk);
+      for(auto& value : data)
+      {
+        value = static_cast<float>(next++);
+      }
+      ring.push(data.data(), data.size());
+
+      check(ring.written() == next, "written after a push of " + std::to_string(chunk));
+      check(ring.size() == std::min<uint64_t>(next, ring.capacity()), "size after a push of " + std::to_string(chunk));
+
+      // every run that still fits is contiguous, ending now or earlier
+      for(uint64_t end = next; end + ring.capacity() > next && end > 0; --end)
+      {
+        const size_t longest = static_cast<size_t>(std::min<uint64_t>(end, ring.capacity() - (next - end)));
+        for(size_t n = 1; n <= longest; ++n)
+        {
+          const float* run = end == next ? ring.latest(n) : ring.at(end, n);
+          for(size_t i = 0; i < n; ++i)
+          {
+            mismatches += run[i] != static_cast<float>(end - n + i);
+          }
+        }
+      }
+    }
+    check(mismatches == 0, std::to_string(mismatches) + " samples differ");
+
+    ring.clear();
+    check(ring.written() == 0 && ring.size() == 0, "empty after clear");
+  }
+
+  void testClearPlans()
+  {
+    auto signal = makeSignal(4096);
+
+    a2i::Spectrogram g;
+    g.setAudioInfo(sample_rate, {-90, 50});
+    g.setFrameSize(1024);
+    g.setWindowFunc(a2i::HANN);
+
+    g.addWindow(signal.data());
+    g.fft();
+    g.normalize();
+    const std::vector<float> before = g.out;
+
+    // the instance must not run the plan that clearPlans() destroyed
+    a2i::Spectrogram::clearPlans();
+    g.addWindow(signal.data());
+    g.fft();
+    g.normalize();
+    check(g.out == before, "same output with a fresh plan");
+  }
+
+  // the spectrum of one frame run through a separate instance
+  a2i::Spectrum spectrumOf(a2i::Spectrogram& reference, const float* frame)
+  {
+    reference.addWindow(frame);
+    reference.fft();
+    reference.normalize();
+    return reference.out;
+  }
+
+  a2i::Spectrogram makeStreaming(unsigned int frame_size, unsigned int hop_size, size_t queue_size)
+  {
+    a2i::Spectrogram g;
+    g.setAudioInfo(sample_rate, {-90, 50});
+    g.setFrameSize(frame_size);
+    g.setWindowFunc(a2i::HANN);
+    g.setHopSize(hop_size);
+    g.setQueueSize(queue_size);
+    return g;
+  }
+
+  void testProcessHopCount()
+  {
+    const unsigned int frame_size = 2048;
+    const unsigned int hop = 300;
+    auto signal = makeSignal(sample_rate);
+
+    a2i::Spectrogram g = makeStreaming(frame_size, hop, 256);
+    a2i::Spectrogram reference(g);
+    a2i::Spectrum spectrum;
+    check(!g.popSpectrum(spectrum), "pop from an empty queue");
+
+    // uneven chunks, some shorter than a hop and some longer than a frame
+    const size_t chunks[] = {100, 2500, 7, 4096, 301};
+    size_t offset = 0;
+    size_t produced = 0;
+    size_t popped = 0;
+    size_t mismatches = 0;
+    for(size_t i = 0; offset < signal.size(); ++i)
+    {
+      const size_t chunk = std::min(chunks[i % 5], signal.size() - offset);
+      g.push(signal.data() + offset, chunk);
+      offset += chunk;
+      produced += g.process();
+
+      while(g.popSpectrum(spectrum))
+      {
+        mismatches += spectrum != spectrumOf(reference, signal.data() + popped * hop);
+        ++popped;
+      }
+    }
+
+    const size_t expected = (signal.size() - frame_size) / hop + 1;
+    check(produced == expected, "process() produced " + std::to_string(produced) + " of " + std::to_string(expected));
+    check(popped == expected, "popped " + std::to_string(popped) + " of " + std::to_string(expected));
+    check(mismatches == 0, std::to_string(mismatches) + " spectra differ from their frames");
+    check(!g.popSpectrum(spectrum), "pop from a drained queue");
+  }
+
+  void testProcessOverrun()
+  {
+    const unsigned int frame_size = 1024;
+    const unsigned int hop = 256;
+    auto signal = makeSignal(200000);
+
+    a2i::Spectrogram g = makeStreaming(frame_size, hop, 1024);
+    a2i::Spectrogram reference(g);
+    const uint64_t overruns = a2i::Profiler::instance().counter(a2i::COUNTER_OVERRUNS);
+    const uint64_t dropped = a2i::Profiler::instance().counter(a2i::COUNTER_DROPPED);
+
+    // more than the whole history at once, the oldest frames are gone
+    g.push(signal.data(), signal.size());
+    const size_t produced = g.process();
+
+    // frames are still on the hop grid, the first one lies fully in the history
+    const size_t capacity = g.in.capacity();
+    const size_t first = (signal.size() - capacity + hop - 1) / hop;
+    const size_t last = (signal.size() - frame_size) / hop;
+    check(produced == last - first + 1, "produced " + std::to_string(produced) + " of " + std::to_string(last - first + 1));
+
+    a2i::Spectrum spectrum;
+    size_t mismatches = 0;
+    for(size_t frame = first; frame <= last && g.popSpectrum(spectrum); ++frame)
+    {
+      mismatches += spectrum != spectrumOf(reference, signal.data() + frame * hop);
+    }
+    check(mismatches == 0, std::to_string(mismatches) + " spectra differ from their frames");
+    check(!g.popSpectrum(spectrum), "no spectra for skipped frames");
+
+    if(a2i::Profiler::enabled())
+    {
+      check(a2i::Profiler::instance().counter(a2i::COUNTER_OVERRUNS) == overruns + 1, "one overrun counted");
+      check(a2i::Profiler::instance().counter(a2i::COUNTER_DROPPED) == dropped + first, "skipped frames counted as dropped");
+    }
+  }
+
+  void testQueueFull()
+  {
+    const unsigned int frame_size = 1024;
+    const unsigned int hop = 512;
+    const size_t queue_size = 4;
+    auto signal = makeSignal(16384);
+
+    a2i::Spectrogram g = makeStreaming(frame_size, hop, queue_size);
+    a2i::Spectrogram reference(g);
+    const uint64_t late = a2i::Profiler::instance().counter(a2i::COUNTER_LATE);
+
+    g.push(signal.data(), signal.size());
+    const size_t produced = g.process();
+    check(produced == (signal.size() - frame_size) / hop + 1, "produced " + std::to_string(produced));
+
+    // the newest spectra replace the oldest unread ones
+    a2i::Spectrum spectrum;
+    size_t mismatches = 0;
+    for(size_t frame = produced - queue_size; frame < produced; ++frame)
+    {
+      check(g.popSpectrum(spectrum), "pop queued spectrum " + std::to_string(frame));
+      mismatches += spectrum != spectrumOf(reference, signal.data() + frame * hop);
+    }
+    check(mismatches == 0, std::to_string(mismatches) + " spectra differ from their frames");
+    check(!g.popSpectrum(spectrum), "pop past the queued spectra");
+
+    if(a2i::Profiler::enabled())
+    {
+      check(a2i::Profiler::instance().counter(a2i::COUNTER_LATE) == late + produced - queue_size, "replaced spectra counted as late");
+    }
+  }
+
+  void testPowerToDbKernels()
+  {
+    const float multiplier = 20;
+
+    // 0, denormals, the smallest normals and a log-spaced sweep over the whole float range
+    std::vector<float> powers = {0.0f, std::numeric_limits<float>::denorm_min(), 1e-42f, 1e-39f, std::numeric_limits<float>::min()};
+    for(int i = 0; i <= 1000; ++i)
+    {
+      powers.push_back(std::pow(10.0f, -38.0f + 76.0f * i / 1000));
+    }
+
+    // just inside and just outside both edges of the clamp range
+    const std::pair<int, int> range = {-90, 50};
+    for(int edge : {range.first, range.second})
+    {
+      for(float offset : {-1e-2f, -1e-4f, 0.0f, 1e-4f, 1e-2f})
+      {
+        powers.push_back(std::pow(10.0f, (edge + offset) / multiplier));
+      }
+    }
+
+    std::vector<std::complex<float>> in;
+    for(float power : powers)
+    {
+      in.emplace_back(std::sqrt(power), 0.0f);
+    }
+
+    // documented error of the fast log plus the rounding of the result itself
+    auto tolerance = [](float db) { return 1.2e-4f + 2 * std::abs(db) * std::numeric_limits<float>::epsilon(); };
+
+    std::vector<float> exact(in.size());
+    std::vector<float> clamped(in.size());
+    std::vector<float> out(in.size());
+    a2i::dsp::powerToDbExact(in.data(), exact.data(), in.size(), 1.0f, multiplier, -1000, 1000);
+    a2i::dsp::powerToDbExact(in.data(), clamped.data(), in.size(), 1.0f, multiplier, range.first, range.second);
+
+    for(const auto& kernel : a2i::dsp::kernels())
+    {
+      const std::string name = std::string(kernel.name) + ": ";
+
+      size_t errors = 0;
+      float error = 0;
+      kernel.func(in.data(), out.data(), in.size(), 1.0f, multiplier, -1000, 1000);
+      for(size_t i = 0; i < in.size(); ++i)
+      {
+        errors += !(std::abs(out[i] - exact[i]) <= tolerance(exact[i]));
+        error = std::max(error, std::abs(out[i] - exact[i]));
+      }
+      check(errors == 0, name + std::to_string(errors) + " values off, max error " + std::to_string(error) + " dB");
+
+      // below the range is min + 1, above it min - 1, within the error either side of an edge is fine
+      size_t wrong = 0;
+      kernel.func(in.data(), out.data(), in.size(), 1.0f, multiplier, range.first, range.second);
+      for(size_t i = 0; i < in.size(); ++i)
+      {
+        const float db = exact[i];
+        const float below = range.first + 1.0f;
+        const float above = range.first - 1.0f;
+        const bool near_edge = std::abs(db - range.first) <= tolerance(db) || std::abs(db - range.second) <= tolerance(db);
+        const bool in_range = std::abs(out[i] - db) <= tolerance(db);
+
+        if(db < range.first && !near_edge) wrong += out[i] != below || clamped[i] != below;
+        else if(db > range.second && !near_edge) wrong += out[i] != above || clamped[i] != above;
+        else if(near_edge) wrong += !in_range && out[i] != below && out[i] != above;
+        else wrong += !in_range;
+      }
+      check(wrong == 0, name + std::to_string(wrong) + " values clamped wrong");
+    }
+  }
+
+  void testStftMatchesSequential()
+  {
+    const unsigned int frame_size = 2048;
+    auto signal = makeSignal(sample_rate);
+
+    a2i::Spectrogram prototype;
+    prototype.setAudioInfo(sample_rate, {-90, 50});
+    prototype.setFreqRange({20, 20000});
+    prototype.setFrameSize(frame_size);
+    prototype.setWindowFunc(a2i::HANN);
+    prototype.setHopSize(300);
+
+    for(unsigned int threads : {1u, 4u})
+    {
+      a2i::Stft stft(prototype, threads);
+      std::vector<float> parallel;
+      stft.run(signal.data(), signal.size(), parallel);
+
+      const size_t bins = frame_size / 2;
+      const size_t frames = stft.frames(signal.size());
+      check(frames == (signal.size() - frame_size) / 300 + 1, "frame count");
+      check(parallel.size() == frames * bins, "output size");
+
+      a2i::Spectrogram sequential(prototype);
+      size_t mismatches = 0;
+      for(size_t frame = 0; frame < frames && parallel.size() == frames * bins; ++frame)
+      {
+        sequential.addWindow(signal.data() + frame * 300);
+        sequential.fft();
+        sequential.normalize();
+
+        if(memcmp(sequential.out.data(), parallel.data() + frame * bins, bins * sizeof(float)) != 0)
+        {
+          ++mismatches;
+        }
+      }
+      check(mismatches == 0, std::to_string(threads) + " threads: " + std::to_string(mismatches) + " frames differ");
+    }
+  }
+
+  // every frame of a MultiChannelSpectrogram, run over an interleaved signal
+  std::vector<std::vector<a2i::Spectrum>> multiChannelFrames(
+    const std::vector<std::vector<float>>& channels, int mode, unsigned int frame_size, unsigned int hop)
+  {
+    const size_t frames = channels[0].size();
+    std::vector<float> interleaved(frames * channels.size());
+    for(size_t i = 0; i < frames; ++i)
+    {
+      for(size_t c = 0; c < channels.size(); ++c)
+      {
+        interleaved[i * channels.size() + c] = channels[c][i];
+      }
+    }
+
+    a2i::MultiChannelSpectrogram mc;
+    mc.setAudioInfo(sample_rate, {-90, 50});
+    mc.setChannels(channels.size(), mode);
+    mc.setFrameSize(frame_size);
+    mc.setWindowFunc(a2i::HANN);
+    mc.setHopSize(hop);
+    mc.setQueueSize(64);
+
+    // chunks longer than the push block and shorter than a hop
+    std::vector<std::vector<a2i::Spectrum>> spectra;
+    const size_t chunks[] = {3000, 7, 1500, 250};
+    for(size_t offset = 0, i = 0; offset < frames; ++i)
+    {
+      const size_t chunk = std::min(chunks[i % 4], frames - offset);
+      mc.push(interleaved.data() + offset * channels.size(), chunk);
+      offset += chunk;
+
+      mc.process();
+
+      std::vector<a2i::Spectrum> frame;
+      while(mc.popSpectra(frame))
+      {
+        spectra.push_back(frame);
+      }
+    }
+
+    return spectra;
+  }
+
+  // largest dB difference between two spectra
+  float maxDifference(const a2i::Spectrum& a, const a2i::Spectrum& b)
+  {
+    if(a.size() != b.size()) return std::numeric_limits<float>::infinity();
+
+    float difference = 0;
+    for(size_t i = 0; i < a.size(); ++i)
+    {
+      difference = std::max(difference, std::abs(a[i] - b[i]));
+    }
+    return difference;
+  }
+
+  void testMultiChannelMatchesSpectrogram()
+  {
+    const unsigned int frame_size = 1024;
+    const unsigned int hop = 300;
+    const size_t bins = frame_size / 2;
+
+    // three different channels, the third one out of phase with the first
+    auto signal = makeSignal(20000);
+    std::vector<std::vector<float>> channels(3, std::vector<float>(signal.size()));
+    for(size_t i = 0; i < signal.size(); ++i)
+    {
+      channels[0][i] = signal[i];
+      channels[1][i] = 0.5f * signal[signal.size() - 1 - i];
+      channels[2][i] = -signal[i] + 0.1f * std::sin(2 * M_PI * 7000 * i / sample_rate);
+    }
+
+    a2i::Spectrogram reference = makeStreaming(frame_size, hop, 0);
+    const size_t expected = (signal.size() - frame_size) / hop + 1;
+
+    // the batched plan may split the work differently from a single one, so
+    // bins are compared to a rounding tolerance instead of bit for bit
+    const float tolerance = 1e-3f;
+
+    std::vector<float> mid(signal.size());
+    std::vector<float> side(signal.size());
+    for(size_t i = 0; i < signal.size(); ++i)
+    {
+      mid[i] = 0.5f * (channels[0][i] + channels[1][i]);
+      side[i] = 0.5f * (channels[0][i] - channels[1][i]);
+    }
+
+    // mid and side of the first pair, the odd third channel passes through
+    const std::vector<std::pair<int, std::vector<const std::vector<float>*>>> layouts = {
+      {a2i::PER_CHANNEL, {&channels[0], &channels[1], &channels[2]}},
+      {a2i::MID_SIDE, {&mid, &side, &channels[2]}},
+    };
+
+    for(const auto& [mode, sources] : layouts)
+    {
+      const std::string name = mode == a2i::MID_SIDE ? "mid/side" : "per channel";
+      auto spectra = multiChannelFrames(channels, mode, frame_size, hop);
+      check(spectra.size() == expected, name + ": " + std::to_string(spectra.size()) + " frames of " + std::to_string(expected));
+
+      float worst = 0;
+      for(size_t frame = 0; frame < spectra.size(); ++frame)
+      {
+        check(spectra[frame].size() == sources.size(), name + ": one spectrum per output");
+
+        for(size_t c = 0; c < sources.size() && c < spectra[frame].size(); ++c)
+        {
+          worst = std::max(worst, maxDifference(spectra[frame][c], spectrumOf(reference, sources[c]->data() + frame * hop)));
+        }
+      }
+      check(worst < tolerance, name + ": bins differ by up to " + std::to_string(worst) + " dB");
+    }
+
+    // SUM adds the bin powers of every channel, so the out-of-phase third
+    // channel does not cancel the first
+    auto spectra = multiChannelFrames(channels, a2i::SUM, frame_size, hop);
+    check(spectra.size() == expected, "sum: frame count");
+
+    std::vector<float> power(bins);
+    a2i::Spectrum summed(bins);
+    float worst = 0;
+    for(size_t frame = 0; frame < spectra.size(); ++frame)
+    {
+      check(spectra[frame].size() == 1, "sum: one spectrum");
+
+      std::fill(power.begin(), power.end(), 0.0f);
+      for(const auto& channel : channels)
+      {
+        reference.addWindow(channel.data() + frame * hop);
+        reference.fft();
+        for(size_t i = 0; i < bins; ++i)
+        {
+          power[i] += std::norm(reference.fft_out[i]);
+        }
+      }
+      a2i::dsp::powerValuesToDb(power.data(), summed.data(), bins, 1.0f / frame_size, 20, -90, 50);
+
+      if(!spectra[frame].empty())
+      {
+        worst = std::max(worst, maxDifference(spectra[frame][0], summed));
+      }
+    }
+    check(worst < tolerance, "sum: bins differ by up to " + std::to_string(worst) + " dB");
+  }
+
+  void testStftFileRoundTrip()
+  {
+    const uint32_t bins = 257;
+    const uint64_t frames = 40;
+    const std::string path = tempPath("round_trip.a2is");
+
+    std::vector<float> values(frames * bins);
+    std::mt19937 rng(7);
+    std::uniform_real_distribution<float> db(-90.0f, 50.0f);
+    for(auto& value : values)
+    {
+      value = db(rng);
+    }
+
+    for(int format : {a2i::FLOAT32, a2i::UINT8, a2i::UINT16})
+    {
+      const std::string name = "format " + std::to_string(format) + ": ";
+
+      a2i::StftHeader header;
+      header.sample_rate = sample_rate;
+      header.frame_size = (bins - 1) * 2;
+      header.hop_size = 128;
+      header.db_min = -90;
+      header.db_max = 50;
+      header.bins = bins;
+      header.format = format;
+
+      a2i::StftWriter writer;
+      check(writer.open(path, header), name + "open writer");
+
+      // the first half in order, the second half out of order as --render writes it
+      for(uint64_t i = 0; i < frames / 2; ++i)
+      {
+        check(writer.append(values.data() + i * bins), name + "append");
+      }
+      for(uint64_t i = frames; i-- > frames / 2;)
+      {
+        check(writer.write(i, values.data() + i * bins), name + "write");
+      }
+
+      // a reader follows a file that is still open once it is flushed
+      a2i::StftReader reader;
+      writer.flush();
+      check(reader.open(path), name + "open reader");
+      check(reader.frames() == frames, name + "frame count while writing");
+      writer.close();
+      check(!writer.append(values.data()), name + "append after close");
+
+      check(reader.refresh(), name + "refresh");
+      check(reader.header().bins == bins && reader.header().hop_size == 128, name + "header");
+      check(reader.frames() == frames, name + "frame count");
+
+      // half a quantization step of the format
+      const float tolerance = format == a2i::UINT8 ? 140.0f / 255 / 2 + 1e-4f
+                            : format == a2i::UINT16 ? 140.0f / 65535 / 2 + 1e-4f
+                            : 0.0f;
+
+      std::vector<float> frame(bins);
+      float error = 0;
+      for(uint64_t i = 0; i < reader.frames(); ++i)
+      {
+        reader.frame(i, frame.data());
+        for(uint32_t b = 0; b < bins; ++b)
+        {
+          error = std::max(error, std::abs(frame[b] - values[i * bins + b]));
+        }
+      }
+      check(error <= tolerance, name + "max error " + std::to_string(error));
+    }
+
+    // version 1 had no scale field, anything newer than this build is unknown
+    for(uint32_t version : {1u, a2i::stft_file_version + 1})
+    {
+      FILE* file = fopen(path.c_str(), "rb+");
+      check(file != nullptr, "reopen file");
+      if(!file)
+      {
+        break;
+      }
+      fseek(file, offsetof(a2i::StftHeader, version), SEEK_SET);
+      fwrite(&version, sizeof(version), 1, file);
+      fclose(file);
+
+      a2i::StftReader reader;
+      check(reader.open(path) == (version <= a2i::stft_file_version), "open version " + std::to_string(version));
+    }
+
+    a2i::StftWriter closed;
+    check(!closed.append(values.data()), "append without open");
+    check(!closed.write(0, values.data()), "write without open");
+
+    // quantization divides by the dB range
+    a2i::StftHeader empty_range;
+    empty_range.db_min = 10;
+    empty_range.db_max = 10;
+    check(!closed.open(path, empty_range), "open with db_max == db_min");
+    empty_range.db_max = -10;
+    check(!closed.open(path, empty_range), "open with db_max < db_min");
+    check(!closed.append(values.data()), "append after a rejected open");
+
+#ifndef _WIN32
+    // the header write fails on a full device, open() must not keep the file
+    a2i::StftHeader header;
+    header.db_min = -90;
+    header.db_max = 50;
+    header.bins = bins;
+    if(std::filesystem::exists("/dev/full"))
+    {
+      check(!closed.open("/dev/full", header), "open on a full device");
+      check(!closed.append(values.data()), "append after a failed header write");
+    }
+#endif
+
+    std::filesystem::remove(path);
+  }
+
+  void testFilterbankBandCentres()
+  {
+    const unsigned int frame_size = 4096;
+    const std::vector<std::pair<int, std::string>> scales = {{a2i::MEL, "mel"}, {a2i::ERB, "erb"}, {a2i::CQT, "cqt"}};
+
+    for(const auto& [scale, name] : scales)
+    {
+      a2i::Spectrogram g;
+      g.setAudioInfo(sample_rate, {-200, 100});
+      g.setFreqRange({20, 30000});  // past Nyquist, the bands must stop at it
+      g.setFrameSize(frame_size);
+      g.setWindowFunc(a2i::HANN);
+      g.setFilterbank(scale, 64);
+
+      const auto& centers = g.getFilterbank()->centers();
+      check(centers.back() < sample_rate / 2, name + ": last centre below Nyquist");
+
+      std::vector<float> levels;
+      for(size_t band : {16, 32, 48, 63})
+      {
+        std::vector<float> tone(frame_size);
+        for(size_t i = 0; i < frame_size; ++i)
+        {
+          tone[i] = 0.5 * std::sin(2 * M_PI * centers[band] * i / sample_rate);
+        }
+
+        g.addWindow(tone.data());
+        g.fft();
+        g.normalize();
+
+        const size_t loudest = std::max_element(g.bands.begin(), g.bands.end()) - g.bands.begin();
+        check(loudest == band, name + ": tone at band " + std::to_string(band) + " peaks in band " + std::to_string(loudest));
+        levels.push_back(g.bands[band]);
+      }
+
+      // every kernel carries one Hann window of its own length, so a tone
+      // reads the same in every band unless the frame is windowed again
+      if(scale == a2i::CQT)
+      {
+        const auto [low, high] = std::minmax_element(levels.begin(), levels.begin() + 3);
+        check(*high - *low < 0.5f, "cqt: band levels differ by " + std::to_string(*high - *low) + " dB");
+      }
+    }
+  }
+
+  void testFeatures()
+  {
+    const unsigned int frame_size = 4096;
+    const double hz_per_bin = static_cast<double>(sample_rate) / frame_size;
+
+    a2i::Spectrogram g;
+    g.setAudioInfo(sample_rate, {-200, 100});
+    g.setFrameSize(frame_size);
+    g.setWindowFunc(a2i::HANN);
+    g.setFeatures(true);
+
+    auto run = [&](const std::vector<float>& frame)
+    {
+      g.addWindow(frame.data());
+      g.fft();
+      g.normalize();
+      return g.features;
+    };
+
+    std::vector<float> frame(frame_size);
+    for(size_t i = 0; i < frame_size; ++i)
+    {
+      double t = static_cast<double>(i) / sample_rate;
+      frame[i] = 0.5 * std::sin(2 * M_PI * 1000 * t) + 0.25 * std::sin(2 * M_PI * 5000 * t);
+    }
+
+    // window sidelobes leave more local maxima than there is room for
+    auto two_tone = run(frame);
+    check(two_tone.peak_count == a2i::Features::max_peaks, "peaks capped at max_peaks");
+    for(size_t i = 1; i < two_tone.peak_count; ++i)
+    {
+      check(two_tone.peaks[i - 1].db >= two_tone.peaks[i].db, "peak " + std::to_string(i) + " not louder than the one before");
+    }
+    check(std::abs(two_tone.peaks[0].frequency - 1000) < hz_per_bin / 4, "loudest peak at 1000 Hz");
+    check(std::abs(two_tone.peaks[1].frequency - 5000) < hz_per_bin / 4, "second peak at 5000 Hz");
+
+    // 80% of the power is in the lower tone, so 85% is reached in the upper one
+    check(two_tone.centroid > 1000 && two_tone.centroid < 5000, "centroid between the tones");
+    check(two_tone.rolloff > 1000 && two_tone.rolloff <= 5000 + hz_per_bin, "rolloff between the tones");
+    check(two_tone.flatness < 0.01f, "flatness of two tones is about 0");
+
+    auto same = run(frame);
+    check(same.flux == 0, "no flux between identical frames");
+
+    // a white noise periodogram has exponential bin powers, whose geometric
+    // over arithmetic mean is exp(-gamma) ~ 0.56
+    std::mt19937 rng(42);
+    std::normal_distribution<float> noise(0.0f, 0.1f);
+    std::vector<float> white(frame_size);
+    for(auto& sample : white)
+    {
+      sample = noise(rng);
+    }
+    auto noisy = run(white);
+    check(noisy.flatness > 0.45f && noisy.flatness < 0.7f, "flatness of white noise is " + std::to_string(noisy.flatness));
+
+    // over 90 periods of 1 kHz, some sample lands within 0.01 dB of a crest
+    for(size_t i = 0; i < frame_size; ++i)
+    {
+      frame[i] = std::sin(2 * M_PI * 1000 * i / sample_rate);
+    }
+    auto full_scale = run(frame);
+    check(std::abs(full_scale.rms + 3.0103f) < 0.05f, "full-scale sine rms is " + std::to_string(full_scale.rms) + " dBFS");
+    check(full_scale.peak <= 0 && full_scale.peak > -0.01f, "full-scale sine peak is " + std::to_string(full_scale.peak) + " dBFS");
+  }
+
+  void testPyramid()
+  {
+    const uint32_t bins = 16;
+    const uint64_t columns = 11;
+    const std::string dir = tempPath("pyramid");
+    std::filesystem::remove_all(dir);
+
+    a2i::StftHeader header;
+    header.sample_rate = sample_rate;
+    header.frame_size = 1024;
+    header.hop_size = 256;
+    header.db_min = -90;
+    header.db_max = 50;
+    header.bins = bins;
+
+    std::vector<float> values(columns * bins);
+    std::mt19937 rng(3);
+    std::uniform_real_distribution<float> db(-90.0f, 50.0f);
+    for(auto& value : values)
+    {
+      value = db(rng);
+    }
+
+    a2i::PyramidWriter writer;
+    check(writer.open(dir, header, a2i::POOL_MAX), "open writer");
+
+    // a reader follows the writer while it runs
+    for(uint64_t i = 0; i < 6; ++i)
+    {
+      writer.append(values.data() + i * bins);
+    }
+    writer.flush();
+
+    a2i::PyramidReader reader;
+    check(reader.open(dir), "open reader");
+    check(reader.columns(0) == 6, "level 0 while writing");
+    check(reader.refresh() && reader.columns(0) == 6, "refresh without new columns");
+
+    for(uint64_t i = 6; i < columns; ++i)
+    {
+      writer.append(values.data() + i * bins);
+    }
+    writer.flush();
+    check(reader.refresh() && reader.columns(0) == columns, "refresh after appending");
+
+    // the odd column at the end of every level is carried up on close
+    writer.close();
+    check(reader.refresh(), "refresh after close");
+
+    const uint64_t expected[] = {11, 6, 3, 2, 1};
+    check(reader.levels() == 5, "level count " + std::to_string(reader.levels()));
+    check(reader.header().format == a2i::UINT8, "levels are uint8");
+
+    std::vector<float> base(columns * bins);
+    for(uint64_t i = 0; i < std::min(reader.columns(0), columns); ++i)
+    {
+      reader.column(0, i, base.data() + i * bins);
+    }
+
+    // column j of level L is the max over base columns [j 2^L, (j + 1) 2^L)
+    std::vector<float> column(bins);
+    for(size_t level = 0; level < std::min<size_t>(reader.levels(), 5); ++level)
+    {
+      const std::string name = "level " + std::to_string(level) + ": ";
+      check(reader.columns(level) == expected[level], name + "column count " + std::to_string(reader.columns(level)));
+
+      size_t mismatches = 0;
+      for(uint64_t j = 0; j < std::min(reader.columns(level), expected[level]); ++j)
+      {
+        reader.column(level, j, column.data());
+
+        const uint64_t first = j << level;
+        const uint64_t last = std::min(columns, (j + 1) << level);
+        for(uint32_t b = 0; b < bins; ++b)
+        {
+          float max = base[first * bins + b];
+          for(uint64_t i = first + 1; i < last; ++i)
+          {
+            max = std::max(max, base[i * bins + b]);
+          }
+          mismatches += column[b] != max;
+        }
+      }
+      check(mismatches == 0, name + std::to_string(mismatches) + " values differ");
+    }
+
+    check(reader.levelFor(1) == 0 && reader.levelFor(4) == 2 && reader.levelFor(1000) == 4, "levelFor");
+
+    reader.close();
+    std::filesystem::remove_all(dir);
+  }
+
+  // RIFF/WAVE bytes with an odd-sized chunk before the data, so the reader
+  // must skip its pad byte
+  std::vector<uint8_t> makeWav(uint16_t format, uint16_t channels, uint16_t bits, const std::vector<uint8_t>& data, uint32_t data_size, bool extensible = false)
+  {
+    std::vector<uint8_t> bytes;
+    auto put = [&](uint64_t value, size_t size)
+    {
+      for(size_t i = 0; i < size; ++i) bytes.push_back(static_cast<uint8_t>(value >> (8 * i)));
+    };
+    auto tag = [&](const char* id)
+    {
+      for(size_t i = 0; i < 4; ++i) bytes.push_back(static_cast<uint8_t>(id[i]));
+    };
+
+    tag("RIFF");
+    put(0, 4);
+    tag("WAVE");
+    tag("fmt ");
+    put(extensible ? 40 : 16, 4);
+    put(extensible ? 0xFFFE : format, 2);
+    put(channels, 2);
+    put(sample_rate, 4);
+    put(sample_rate * channels * bits / 8, 4);
+    put(channels * bits / 8, 2);
+    put(bits, 2);
+    if(extensible)
+    {
+      put(22, 2);
+      put(bits, 2);
+      put(0, 4);
+      put(format, 2);
+      put(0, 14);
+    }
+    tag("LIST");
+    put(3, 4);
+    put(0, 4);
+    tag("data");
+    put(data_size, 4);
+    bytes.insert(bytes.end(), data.begin(), data.end());
+
+    const uint32_t riff_size = bytes.size() - 8;
+    memcpy(bytes.data() + 4, &riff_size, 4);
+    return bytes;
+  }
+
+  bool loadBytes(const std::vector<uint8_t>& bytes, std::vector<float>& samples, unsigned int& rate, unsigned int& channels)
+  {
+    const std::string path = tempPath("input.wav");
+    FILE* file = fopen(path.c_str(), "wb");
+    fwrite(bytes.data(), 1, bytes.size(), file);
+    fclose(file);
+
+    const bool loaded = a2i::loadWav(path, samples, rate, channels);
+    std::filesystem::remove(path);
+    return loaded;
+  }
+
+  void testWavFormats()
+  {
+    std::vector<float> samples;
+    unsigned int rate = 0;
+    unsigned int channels = 0;
+
+    struct Format
+    {
+      std::string name;
+      uint16_t format;
+      uint16_t channels;
+      uint16_t bits;
+      bool extensible;
+      std::vector<uint8_t> data;
+      std::vector<float> expected;
+    };
+
+    const std::vector<Format> formats = {
+      {"u8", 1, 1, 8, false, {0, 128, 255}, {-1.0f, 0.0f, 127 / 128.0f}},
+      {"s16", 1, 2, 16, false, {0x00, 0x80, 0xff, 0x7f, 0x00, 0x40, 0xff, 0xff}, {-1.0f, 32767 / 32768.0f, 0.5f, -1 / 32768.0f}},
+      {"s24", 1, 1, 24, false, {0x00, 0x00, 0x80, 0xff, 0xff, 0x7f, 0xff, 0xff, 0xff}, {-1.0f, 8388607 / 8388608.0f, -1 / 8388608.0f}},
+      {"s32 extensible", 1, 1, 32, true, {0x00, 0x00, 0x00, 0xc0}, {-0.5f}},
+      {"f32 extensible", 3, 3, 32, true, {0x00, 0x00, 0x80, 0x3f, 0x00, 0x00, 0x00, 0xbf, 0x00, 0x00, 0x00, 0x00}, {1.0f, -0.5f, 0.0f}},
+    };
+
+    for(const auto& format : formats)
+    {
+      auto bytes = makeWav(format.format, format.channels, format.bits, format.data, format.data.size(), format.extensible);
+      const bool loaded = loadBytes(bytes, samples, rate, channels);
+      check(loaded, format.name + ": loaded");
+      check(rate == sample_rate && channels == format.channels, format.name + ": rate and channels");
+      check(samples == format.expected, format.name + ": samples");
+    }
+
+    // streaming encoders leave the data size unset, half a frame is dropped
+    std::vector<uint8_t> data(4 * 5 + 2, 0x10);
+    check(loadBytes(makeWav(1, 2, 16, data, 0xFFFFFFFF), samples, rate, channels), "unset data size: loaded");
+    check(samples.size() == 10, "unset data size: " + std::to_string(samples.size()) + " samples");
+
+    check(!loadBytes(makeWav(2, 1, 4, {0, 0}, 2), samples, rate, channels), "ADPCM is rejected");
+    check(!loadBytes({'R', 'I', 'F', 'F', 0, 0, 0, 0, 'A', 'V', 'I', ' '}, samples, rate, channels), "non-WAVE RIFF is rejected");
+    check(!a2i::loadWav(tempPath("missing.wav"), samples, rate, channels), "missing file is rejected");
+  }
+
+#ifndef _WIN32
+  // feeds bytes through a named pipe in pieces that split frames and samples
+  template<typename T>
+  std::vector<float> readPiecewise(const std::vector<T>& samples, int format, unsigned int channels, bool mono)
+  {
+    const std::string path = tempPath("pcm.fifo");
+    unlink(path.c_str());
+    if(mkfifo(path.c_str(), 0600) != 0)
+    {
+      check(false, "mkfifo");
+      return {};
+    }
+
+    std::thread writer([&]
+    {
+      int fd = ::open(path.c_str(), O_WRONLY);
+      const uint8_t* bytes = reinterpret_cast<const uint8_t*>(samples.data());
+      const size_t total = samples.size() * sizeof(T);
+      const size_t pieces[] = {1, 3, 5, 2, 7, 11};
+
+      for(size_t offset = 0, i = 0; offset < total && fd >= 0; ++i)
+      {
+        const size_t n = std::min(pieces[i % 6], total - offset);
+        const ssize_t written = ::write(fd, bytes + offset, n);
+        if(written <= 0) break;
+        offset += static_cast<size_t>(written);
+        std::this_thread::sleep_for(std::chrono::microseconds(200));
+      }
+
+      if(fd >= 0) ::close(fd);
+    });
+
+    a2i::PcmReader reader;
+    std::vector<float> decoded;
+    if(reader.open(path, format, channels, 4))
+    {
+      std::vector<float> block(4 * channels);
+      while(size_t frames = mono ? reader.read(block.data()) : reader.readInterleaved(block.data()))
+      {
+        decoded.insert(decoded.end(), block.begin(), block.begin() + frames * (mono ? 1 : channels));
+      }
+      check(reader.eof(), "eof at the end of the stream");
+    }
+    else
+    {
+      check(false, "open " + path);
+    }
+
+    writer.join();
+    unlink(path.c_str());
+    return decoded;
+  }
+
+  void testPcmReaderCarry()
+  {
+    const unsigned int channels = 2;
+    const size_t frames = 300;
+
+    std::vector<int16_t> s16(frames * channels);
+    std::vector<float> f32(frames * channels);
+    for(size_t i = 0; i < s16.size(); ++i)
+    {
+      s16[i] = static_cast<int16_t>((i * 997) % 65536 - 32768);
+      f32[i] = static_cast<float>(i) / s16.size() - 0.5f;
+    }
+
+    auto mono = readPiecewise(s16, a2i::S16, channels, true);
+    check(mono.size() == frames, "s16 frame count " + std::to_string(mono.size()));
+
+    size_t mismatches = 0;
+    for(size_t i = 0; i < std::min(mono.size(), frames); ++i)
+    {
+      const float expected = (s16[2 * i] + static_cast<float>(s16[2 * i + 1])) * (1.0f / (32768.0f * channels));
+      mismatches += mono[i] != expected;
+    }
+    check(mismatches == 0, "s16 downmix: " + std::to_string(mismatches) + " frames differ");
+
+    auto interleaved = readPiecewise(f32, a2i::F32, channels, false);
+    check(interleaved == f32, "f32 interleaved samples");
+  }
+#endif
+
+  struct Case
+  {
+    std::string name;
+    std::function<void()> body;
+  };
+
+  const std::vector<Case> cases = {
+    {"ring_buffer/wraparound", testRingBufferWraparound},
+    {"spectrogram/clear_plans", testClearPlans},
+    {"spectrogram/hop_count", testProcessHopCount},
+    {"spectrogram/overrun", testProcessOverrun},
+    {"spectrogram/queue_full", testQueueFull},
+    {"dsp/power_to_db", testPowerToDbKernels},
+    {"stft/matches_sequential", testStftMatchesSequential},
+    {"multi_channel/matches_spectrogram", testMultiChannelMatchesSpectrogram},
+    {"stft_file/round_trip", testStftFileRoundTrip},
+    {"filterbank/band_centres", testFilterbankBandCentres},
+    {"features/two_tone", testFeatures},
+    {"pyramid/levels", testPyramid},
+#ifndef _WIN32
+    {"pcm_reader/partial_frames", testPcmReaderCarry},
+#endif
+    {"wav_file/formats", testWavFormats},
+  };
+}
+
+int main(int argc, char** argv)
+{
+  std::string filter;
+  for(int i = 1; i < argc; ++i)
+  {
+    std::string arg = argv[i];
+
+    if(arg.rfind("--filter=", 0) == 0) filter = arg.substr(9);
+    else
+    {
+      std::cerr << "Usage: a2i_tests [--filter=<substring>]\n";
+      return 1;
+    }
+  }
+
+  for(const auto& test : cases)
+  {
+    if(!filter.empty() && test.name.find(filter) == std::string::npos)
+    {
+      continue;
+    }
+
+    const int before = failures;
+    test.body();
+    std::cerr << test.name << ": " << (failures == before ? "ok" : "FAILED") << '\n';
+  }
+
+  return failures ? 1 : 0;
+}
@@ -1,17 +1,69 @@
+#ifndef A2I_HEADLESS
 #include "raylib.h"
-#include <opencv2/opencv.hpp>
+#endif
+#include <opencv2/core.hpp>
+#include <opencv2/imgcodecs.hpp>
+#include <opencv2/imgproc.hpp>
+#include <opencv2/videoio.hpp>
+#ifndef A2I_HEADLESS
 #include <opencv2/highgui.hpp>
+#endif
 #include <a2i/spectrogram.hpp>
+#include <a2i/dsp.hpp>
+#include <a2i/stft.hpp>
+#include <a2i/stft_file.hpp>
+#include <a2i/pcm_reader.hpp>
+#include <a2i/multi_channel_spectrogram.hpp>
+#include <a2i/bounded_queue.hpp>
+#include <a2i/spectrogram_pyramid.hpp>
+#include <a2i/profiler.hpp>
+#include <a2i/render_context.hpp>
+#include <a2i/triple_buffer.hpp>
+#include <a2i/waterfall.hpp>
+#include <a2i/wav_file.hpp>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <memory>
+#include <thread>
+#include <stdio.h>
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#endif
 
 int WINDOW_WIDTH;
 int WINDOW_HEIGHT;
 unsigned int FRAME_SIZE;
 a2i::Spectrogram g;
+a2i::MultiChannelSpectrogram mc;
+
+// the views draw through their own copy of g's layout: drawing fills the
+// bin map and grid caches, and g is analysed on the dsp thread meanwhile
+a2i::Spectrogram layout;
+bool MULTI_CHANNEL = false;
+
+// raylib hands stream processors float frames in its mixing format, which has
+// AUDIO_DEVICE_CHANNELS (2 by default) channels whatever the file has
+constexpr unsigned int CALLBACK_CHANNELS = 2;
 
 int multiplier;
-bool show = false;
 bool DEBUG_MODE = false;
 
+#ifndef A2I_HEADLESS
+// raylib logs to stdout by default, which would end up in the raw output of
+// --frames -, so its messages go to stderr with the rest of the diagnostics
+void traceLog(
+  int log_level,
+  const char *text,
+  va_list args)
+{
+  (void)log_level;
+  vfprintf(stderr, text, args);
+  fputc('\n', stderr);
+}
+#endif
+
 // дебаг инфо больше инфы
 // обширнее хелп
 // больше флагов
@@ -19,41 +71,175 @@ bool DEBUG_MODE = false;
 // ноу видео(тогда с консоли управление добавить)
 // документация
 
-typedef struct 
-{
-  float left;
-  float right;
-} Frame;
-
 void callback(
   void *bufferData, 
   unsigned int frames) 
 {
-  if(frames < 512) return;
+  const float *fs = static_cast<const float*>(bufferData);
+
+  if(MULTI_CHANNEL)
+  {
+    mc.push(fs, frames);
+    return;
+  }
+
+  float mono[1024];
+
+  for(size_t i = 0; i < frames; i += 1024)
+  {
+    size_t n = std::min<size_t>(1024, frames - i);
+
+    for(size_t j = 0; j < n; ++j)
+    {
+      float sum = 0;
+      for(unsigned int c = 0; c < CALLBACK_CHANNELS; ++c)
+      {
+        sum += fs[(i + j) * CALLBACK_CHANNELS + c];
+      }
+      mono[j] = sum / CALLBACK_CHANNELS;
+    }
+
+    g.push(mono, n);
+  }
+}
+
+// one view per spectrum, stacked top to bottom
+struct StackedViews
+{
+  std::vector<std::unique_ptr<a2i::RenderContext>> renders;
+  std::vector<std::unique_ptr<a2i::Waterfall>> waterfalls;
+  cv::Mat canvas;
+  bool waterfall = false;
+
+  StackedViews(size_t count, int rows, int cols, bool waterfall_enabled) :
+    waterfall(waterfall_enabled)
+  {
+    const int view_rows = rows / static_cast<int>(count);
+
+    for(size_t i = 0; i < count; ++i)
+    {
+      renders.push_back(std::make_unique<a2i::RenderContext>(layout, view_rows, cols));
+      waterfalls.push_back(std::make_unique<a2i::Waterfall>(layout, view_rows, cols));
+    }
 
-  Frame *fs = static_cast<Frame*>(bufferData);
+    if(count > 1) canvas.create(view_rows * static_cast<int>(count), cols, CV_8UC3);
+  }
 
-  if(g.in.size() == FRAME_SIZE)
+  cv::Size size() const
   {
-    g.in.erase(g.in.begin(), g.in.begin() + frames);
+    return renders.size() == 1 ? renders[0]->frame().size() : canvas.size();
+  }
+
+  const cv::Mat& render(const a2i::Spectrum& spectrum)
+  {
+    if(waterfall) waterfalls[0]->push(spectrum);
+    return waterfall ? waterfalls[0]->render() : renders[0]->render(spectrum);
+  }
+
+  const cv::Mat& render(const std::vector<a2i::Spectrum>& spectra)
+  {
+    for(size_t i = 0; i < renders.size(); ++i)
+    {
+      if(waterfall) waterfalls[i]->push(spectra[i]);
+      const cv::Mat& frame = waterfall ? waterfalls[i]->render() : renders[i]->render(spectra[i]);
+
+      if(renders.size() == 1) return frame;
+      cv::Mat view = canvas.rowRange(i * frame.rows, (i + 1) * frame.rows);
+      frame.copyTo(view);
+    }
+
+    return canvas;
   }
+};
 
-  for(size_t i = 0 ; i < frames; ++i) 
+void drawStats(cv::Mat& img)
+{
+  const auto& profiler = a2i::Profiler::instance();
+  int y = 20;
+
+  for(int i = 0; i < a2i::STAGE_COUNT; ++i)
   {
-    g.in.push_back((fs[i].left + fs[i].right) / 2);
+    auto stage = profiler.stage(i);
+    std::stringstream ss;
+    ss << std::fixed << std::setprecision(1) << a2i::Profiler::stageName(i) << ": " 
+       << stage.mean_ns / 1000 << " us, p99 " << stage.p99_ns / 1000.0 << " us";
+    cv::putText(img, ss.str(), cv::Point(img.cols - 320, y), cv::FONT_HERSHEY_SIMPLEX, 0.45, cv::Scalar(255, 255, 255), 1);
+    y += 18;
   }
 
-  if(g.in.size() == FRAME_SIZE)
+  std::stringstream ss;
+  ss << "dropped " << profiler.counter(a2i::COUNTER_DROPPED) 
+     << ", late " << profiler.counter(a2i::COUNTER_LATE) 
+     << ", overruns " << profiler.counter(a2i::COUNTER_OVERRUNS);
+  cv::putText(img, ss.str(), cv::Point(img.cols - 320, y), cv::FONT_HERSHEY_SIMPLEX, 0.45, cv::Scalar(255, 255, 255), 1);
+}
+
+bool dumpStats(const std::string& path)
+{
+  const auto& profiler = a2i::Profiler::instance();
+
+  // .json is rewritten with the latest totals, anything else gets a csv row appended
+  if(path.size() >= 5 && path.compare(path.size() - 5, 5, ".json") == 0)
   {
-    g.addWindow();
-    g.fft();
-    g.normalize(multiplier);
-    show = true;
+    std::ofstream file(path);
+    file << profiler.json();
+    return static_cast<bool>(file);
   }
-  else
+
+  bool exists = std::ifstream(path).good();
+  std::ofstream file(path, std::ios::app);
+  if(!exists) file << profiler.csvHeader();
+  file << profiler.csvRow();
+  return static_cast<bool>(file);
+}
+
+bool loadInterleaved(
+  const char* path, 
+  std::vector<float>& interleaved, 
+  unsigned int& sample_rate,
+  unsigned int& channels)
+{
+#ifdef A2I_HEADLESS
+  // headless builds don't link raylib, so only WAV files are decoded
+  return a2i::loadWav(path, interleaved, sample_rate, channels);
+#else
+  Wave wave = LoadWave(path);
+  if(!IsWaveReady(wave)) return false;
+
+  float* samples = LoadWaveSamples(wave);
+  interleaved.assign(samples, samples + static_cast<size_t>(wave.frameCount) * wave.channels);
+
+  sample_rate = wave.sampleRate;
+  channels = wave.channels;
+
+  UnloadWaveSamples(samples);
+  UnloadWave(wave);
+  return true;
+#endif
+}
+
+bool loadMono(
+  const char* path, 
+  std::vector<float>& mono, 
+  unsigned int& sample_rate)
+{
+  unsigned int channels;
+  if(!loadInterleaved(path, mono, sample_rate, channels)) return false;
+
+  // in place, frame i is read before sample i is written
+  const size_t frames = mono.size() / channels;
+  for(size_t i = 0; i < frames; ++i)
   {
-    show = false;
+    float sum = 0;
+    for(size_t c = 0; c < channels; ++c)
+    {
+      sum += mono[i * channels + c];
+    }
+    mono[i] = sum / channels;
   }
+
+  mono.resize(frames);
+  return true;
 }
 
 cv::Scalar parseColor(const std::string& colorStr) 
@@ -95,6 +281,143 @@ std::pair<int, int> parseRange(const std::string& str)
   return std::make_pair(first, second);
 }
 
+bool isFramePattern(const std::string& pattern)
+{
+  // exactly one %d conversion with optional zero padding and width
+  size_t percent = pattern.find('%');
+  if(percent == std::string::npos || pattern.find('%', percent + 1) != std::string::npos)
+  {
+    return false;
+  }
+
+  size_t i = percent + 1;
+  while(i < pattern.size() && isdigit(pattern[i])) ++i;
+  return i < pattern.size() && pattern[i] == 'd';
+}
+
+// bands are already on a perceptual scale, low bands at the bottom
+void drawBands(
+  cv::Mat& heatmap, 
+  const int x, 
+  const a2i::Spectrum& bands, 
+  const std::pair<int, int> db_range)
+{
+  const double db_span = db_range.second - db_range.first;
+  for(int y = 0; y < heatmap.rows; ++y)
+  {
+    size_t band = static_cast<size_t>(heatmap.rows - 1 - y) * bands.size() / heatmap.rows;
+    double value = std::clamp((bands[band] - db_range.first) / db_span, 0.0, 1.0);
+    heatmap.at<uchar>(y, x) = static_cast<uchar>(value * 255);
+  }
+}
+
+#ifndef A2I_HEADLESS
+uint64_t countColumns(const a2i::PyramidReader& pyramid)
+{
+  uint64_t count = 0;
+  for(size_t level = 0; level < pyramid.levels(); ++level)
+  {
+    count += pyramid.columns(level);
+  }
+  return count;
+}
+
+void viewPyramid(
+  a2i::PyramidReader& pyramid, 
+  const int graph_mode, 
+  const int colormap)
+{
+  const a2i::StftHeader header = pyramid.header();
+  const bool bands = header.scale != 0;
+  const double seconds_per_column = static_cast<double>(header.hop_size) / header.sample_rate;
+
+  cv::Mat heatmap(WINDOW_HEIGHT, WINDOW_WIDTH, CV_8UC1);
+  cv::Mat frame;
+  a2i::Spectrum values(header.bins);
+
+  // view in level 0 columns, each level halves the columns per pixel
+  const double min_span = std::max(1.0, heatmap.cols / 8.0);
+  double total = static_cast<double>(pyramid.columns());
+  double span = std::max<double>(total, heatmap.cols);
+  double start = 0;
+  bool dirty = true;
+
+  cv::namedWindow("a2i", cv::WINDOW_NORMAL);
+  cv::resizeWindow("a2i", WINDOW_WIDTH, WINDOW_HEIGHT);
+
+  while(true)
+  {
+    if(dirty)
+    {
+      const double per_pixel = span / heatmap.cols;
+      const size_t level = pyramid.levelFor(per_pixel);
+      const uint64_t count = pyramid.columns(level);
+      uint64_t loaded = UINT64_MAX;
+
+      heatmap.setTo(cv::Scalar(0));
+      for(int x = 0; x < heatmap.cols; ++x)
+      {
+        uint64_t index = static_cast<uint64_t>(start + x * per_pixel) >> level;
+        if(index >= count) break;
+
+        if(index != loaded)
+        {
+          pyramid.column(level, index, values.data());
+          loaded = index;
+        }
+
+        if(bands) drawBands(heatmap, x, values, {header.db_min, header.db_max});
+        else g.drawColumn(heatmap, x, values, graph_mode);
+      }
+
+      if(colormap >= 0) cv::applyColorMap(heatmap, frame, colormap);
+      else cv::cvtColor(heatmap, frame, cv::COLOR_GRAY2BGR);
+
+      std::stringstream ss;
+      ss << std::fixed << std::setprecision(1) << start * seconds_per_column << " s, " 
+         << span * seconds_per_column << " s wide, level " << level;
+      cv::putText(frame, ss.str(), cv::Point(10, 20), cv::FONT_HERSHEY_SIMPLEX, 0.5, cv::Scalar(255, 255, 255), 1);
+
+      cv::imshow("a2i", frame);
+      dirty = false;
+    }
+
+    int key = cv::waitKey(100);
+
+    if(key == 27 || cv::getWindowProperty("a2i", cv::WND_PROP_AUTOSIZE) == 1)  // Esc
+    {
+      break;
+    }
+
+    if(key == -1)
+    {
+      // follow a pyramid that is still being written, levels are remapped
+      // only when their files changed
+      const uint64_t before = countColumns(pyramid);
+      pyramid.refresh();
+      dirty = countColumns(pyramid) != before;
+      total = static_cast<double>(pyramid.columns());
+      continue;
+    }
+
+    const double center = start + span / 2;
+
+    if(key == 83) start += span / 4;  // Right arrow
+    if(key == 81) start -= span / 4;  // Left arrow
+    if(key == 82 || key == '+' || key == '=') span = std::max(span / 2, min_span);  // Up arrow
+    if(key == 84 || key == '-') span = std::min(span * 2, std::max<double>(total, heatmap.cols));  // Down arrow
+    if(key == 82 || key == 84 || key == '+' || key == '=' || key == '-') start = center - span / 2;
+    if(key == 'h') start = 0;
+    if(key == 'e') start = total - span;
+
+    start = std::clamp(start, 0.0, std::max(0.0, total - span));
+    dirty = true;
+  }
+
+  cv::destroyAllWindows();
+}
+#endif
+
 bool isPowerOfTwo(int n) {
   if(n < 512) return false;
   while(n % 2 == 0) 
@@ -113,10 +436,14 @@ void printUsage()
             << "  -w <int>                Window function (0-9, default: 9)\n"
             << "  -l <int>                Line type (0-2, default: 0)\n"
             << "  -g <int>                Graph mode (0-1, default: 1)\n"
+            << "  -agg <int>              Bins per pixel aggregation (0 max, 1 mean, 2 rms, default: 0)\n"
             << "  -m <int>                Normalize multiplier (default: 20)\n"
+            << "  -exact                  Exact dB conversion instead of the SIMD approximation\n"
             << "  -mic                    Use microphone\n"
             << "  -f <int>                Frame size (>=512, default: 65536)\n"
-            << "  -n <int>                Number of previous frames (>0)\n"
+            << "  -hop <int>              Hop size in samples (default: 2048)\n"
+            << "  -overlap <int>          Frame overlap in percent (0-99), overrides -hop\n"
+            << "  -n <int>                Length of the fading trail of previous frames (>0)\n"
             << "  -size <height,width>    Window size (default: 400,2100)\n"
             << "  -grad <int>             Colormap (0-21)\n"
             << "  -fill <int>             Fill type (0-2, default: 2)\n"
@@ -124,17 +451,45 @@ void printUsage()
             << "  -line <color>           Line color (default: 255,255,255)\n"
             << "  -underline <color>      Underline color (default: 127,127,127)\n"
             << "  -grid                   Grid\n"
+            << "  -waterfall              Scrolling time/frequency view instead of the spectrum curve\n"
             << "  -grad_coef <int>        Gradient coefficient (0-255, default: 127)\n"
             << "  -grid_line_color <color> Grid line color\n"
             << "  -grid_text_color <color> Grid text color\n"
+            << "  -plan <int>             FFTW planner (0 estimate, 1 measure, 2 patient, default: 0)\n"
+            << "  -wisdom <path>          FFTW wisdom file (loaded on start, saved on exit)\n"
+            << "  --render <path>         Render the whole file to an image without playback\n"
+            << "  -threads <int>          Worker threads for --render (default: all cores)\n"
+            << "  --stft <path>           Also write the STFT frames of --render to a file\n"
+            << "  -stft_format <int>      STFT file values (0 float32, 1 uint8, 2 uint16, default: 0)\n"
+            << "  -fb <int>               Filterbank for --render/--stft (0 mel, 1 bark, 2 erb, 3 constant-Q)\n"
+            << "  -bands <int>            Number of filterbank bands (default: 128)\n"
+            << "  --features <path>       Write per-frame spectral features of --render as CSV\n"
+            << "  --headless              Decode the file and write frames without window or audio device\n"
+            << "  --frames <pattern>      --headless frames as PNG sequence (out/%06d.png) or - for raw RGB on stdout\n"
+            << "  -pcm <format>           Read raw interleaved PCM (s16, f32) from the path, - for stdin\n"
+            << "  -rate <int>             -pcm sample rate (default: 44100)\n"
+            << "  -channels <int>         -pcm channels (default: 2)\n"
+            << "  -channel_mode <int>     Analyse channels separately (0 per channel, 1 mid/side, 2 power sum), views are stacked\n"
+            << "  --video <path>          Export the live view as a video at -fps, faster than real time\n"
+            << "  -fps <int>              --video frame rate, sets the hop size (default: 60)\n"
+            << "  -fourcc <code>          --video codec (default: mp4v)\n"
+            << "  --pyramid <dir>         Also write a zoomable multi-resolution pyramid of --headless/--video\n"
+            << "  -pool <int>             --pyramid pooling (0 max, 1 mean, default: 0)\n"
+            << "  --view <dir>            Browse a pyramid, no audio file needed\n"
             
+            << "  -stats                  Show per-stage timings over the image\n"
+            << "  -stats_file <path>      Dump timings every second (.json snapshot or csv rows)\n"
             << "  -debug                  Enable debug mode\n"
             << "  -h, -help               Show this help message\n"
             << "Controls:\n"
             << "  Space                   Pause/Resume\n"
             << "  Left Arrow              Rewind 5 seconds\n"
             << "  Right Arrow             Fast Forward 5 seconds\n"
-            << "  Esc                     Exit\n";
+            << "  Esc                     Exit\n"
+            << "View controls (--view):\n"
+            << "  Left/Right Arrow        Pan a quarter of the view\n"
+            << "  Up/Down Arrow, +/-      Zoom in/out 2x\n"
+            << "  h, e                    Jump to start/end\n";
 }
 
 int main(int argc, char** argv) 
@@ -145,10 +500,14 @@ int main(int argc, char** argv)
   "{ w               |       9       | window function(0-9)          }"
   "{ l               |       0       | line type(0-2)                }"
   "{ g               |       1       | graph mode(0-1)               }"
+  "{ agg             |       0       | bin aggregation(0-2)          }"
   "{ m               |       20      | mormalize multiplier          }"
+  "{ exact           |               | exact dB conversion           }"
   "{ mic             |               | use microphone                }"
   "{ f               |     65536     | frame size(>=512)             }"
-  "{ n               |               | number of prev frames(>0)     }"
+  "{ hop             |      2048     | hop size                      }"
+  "{ overlap         |               | frame overlap(0-99)           }"
+  "{ n               |               | trail length in frames(>0)    }"
   "{ size            |   400,2100    | window size(height,width)     }"
   "{ grad            |               | colormap(0-21)                }"
   "{ fill            |       2       | fill type(0-2)                }"
@@ -156,10 +515,34 @@ int main(int argc, char** argv)
   "{ line            |  255,255,255  | line color(255,255,255)       }"
   "{ underline       |  127,127,127  | underline color(127,127,127)  }"
   "{ grid            |               | grid                          }"
+  "{ waterfall       |               | waterfall view                }"
   "{ grad_coef       |      127      | gradient coefficient(0-255)   }"
   "{ grid_line_color |   79,73,80    | grid line color               }"
   "{ grid_text_color |  51,186,243   | grid text color               }"
   "{ volume          |      0.8      | set volume level (0.0-1.0)    }"
+  "{ plan            |       0       | fftw planner(0-2)             }"
+  "{ wisdom          |               | fftw wisdom file              }"
+  "{ render          |               | render file to image          }"
+  "{ threads         |       0       | render worker threads         }"
+  "{ stft            |               | write stft frames to file     }"
+  "{ stft_format     |       0       | stft file values(0-2)         }"
+  "{ fb              |               | filterbank(0-3)               }"
+  "{ bands           |      128      | filterbank bands              }"
+  "{ features        |               | write features csv            }"
+  "{ headless        |               | no window and audio device    }"
+  "{ frames          |               | headless frame output         }"
+  "{ pcm             |               | raw pcm input format          }"
+  "{ rate            |     44100     | raw pcm sample rate           }"
+  "{ channels        |       2       | raw pcm channels              }"
+  "{ channel_mode    |               | multichannel output(0-2)      }"
+  "{ video           |               | export video                  }"
+  "{ fps             |       60      | video frame rate              }"
+  "{ fourcc          |      mp4v     | video codec                   }"
+  "{ pyramid         |               | write pyramid directory       }"
+  "{ pool            |       0       | pyramid pooling(0-1)          }"
+  "{ view            |               | browse pyramid directory      }"
+  "{ stats           |               | timing overlay                }"
+  "{ stats_file      |               | timing dump file              }"
   "{ debug           |               | enable debug mode             }"
   "{ h help          |               | show help message             }");
 
@@ -171,13 +554,30 @@ int main(int argc, char** argv)
 
   DEBUG_MODE = parser.has("debug");
 
+  auto stats_enabled = parser.has("stats");
+  auto stats_file = parser.get<std::string>("stats_file");
+  if((stats_enabled || !stats_file.empty()) && !a2i::Profiler::enabled())
+  {
+    std::cerr << "a2i was built without A2I_PROFILE, timings will be empty" << '\n';
+  }
+
+#ifndef A2I_HEADLESS
+  SetTraceLogCallback(traceLog);
+
   if(!DEBUG_MODE) 
   {
     SetTraceLogLevel(LOG_WARNING);
   }
+#endif
+
+  if(DEBUG_MODE)
+  {
+    std::cerr << "dB kernel: " << a2i::dsp::kernelName() << '\n';
+  }
 
   auto file = parser.get<std::string>("@input");
-  if(file.empty())
+  auto view_path = parser.get<std::string>("view");
+  if(file.empty() && view_path.empty())
   {
     std::cout << "Error: No audio file specified.\n";
     printUsage();
@@ -185,6 +585,12 @@ int main(int argc, char** argv)
   }
   const char *file_path = file.c_str();
   auto amp = parseRange(parser.get<std::string>("a"));
+  if(amp.second <= amp.first)
+  {
+    std::cout << "Invalid -a option" << '\n';
+    std::cout << "Should be min,max with min < max" << '\n';
+    return 0;
+  }
 
   auto window_function = parser.get<int>("w");
   if(window_function < 0 || window_function > 9)
@@ -210,6 +616,14 @@ int main(int argc, char** argv)
     return 0;
   }
 
+  auto aggregation = parser.get<int>("agg");
+  if(aggregation < 0 || aggregation > 2)
+  {
+    std::cout << "Invalid -agg option" << '\n';
+    std::cout << "Should be in range (0-2)" << '\n';
+    return 0;
+  }
+
   multiplier = parser.get<int>("m");
   auto use_mic = parser.has("mic");
 
@@ -221,6 +635,23 @@ int main(int argc, char** argv)
     return 0;
   }
 
+  auto hop_size = parser.get<int>("hop");
+  if(hop_size <= 0)
+  {
+    std::cout << "Invalid -hop option" << '\n';
+    std::cout << "Should be > 0" << '\n';
+    return 0;
+  }
+
+  auto bool_overlap = parser.has("overlap");
+  auto overlap = parser.get<int>("overlap");
+  if(bool_overlap && (overlap < 0 || overlap > 99))
+  {
+    std::cout << "Invalid -overlap option" << '\n';
+    std::cout << "Should be in range (0-99)" << '\n';
+    return 0;
+  }
+
   auto bool_num_frames = parser.has("n");
   auto num_frames = parser.get<int>("n");
   if(bool_num_frames && num_frames <= 0)
@@ -261,6 +692,7 @@ int main(int argc, char** argv)
   auto line_color = parseColor(parser.get<std::string>("line"));
   auto underline_color = parseColor(parser.get<std::string>("underline"));
   auto grid_enabled = parser.has("grid");
+  auto waterfall_enabled = parser.has("waterfall");
 
   auto grad_coefficient = parser.get<int>("grad_coef");
   if(grad_coefficient < 0 || grad_coefficient > 255)
@@ -281,54 +713,686 @@ int main(int argc, char** argv)
     return 0;
   }
 
+  auto planner = parser.get<int>("plan");
+  if(planner < 0 || planner > 2)
+  {
+    std::cout << "Invalid -plan option" << '\n';
+    std::cout << "Should be in range (0-2)" << '\n';
+    return 0;
+  }
+  const unsigned int planner_flags[] = {FFTW_ESTIMATE, FFTW_MEASURE, FFTW_PATIENT};
+
+  auto wisdom = parser.get<std::string>("wisdom");
+  if(!wisdom.empty() && !a2i::Spectrogram::loadWisdom(wisdom) && DEBUG_MODE)
+  {
+    std::cerr << "No FFTW wisdom loaded from " << wisdom << '\n';
+  }
+
+  auto setupSpectrogram = [&](unsigned int sample_rate)
+  {
+    g.setAudioInfo(sample_rate, amp);
+    g.setFreqRange({20, 20000});
+    g.setPlannerFlag(planner_flags[planner]);
+    g.setFrameSize(FRAME_SIZE);
+    if(bool_overlap) g.setOverlap(overlap);
+    else g.setHopSize(hop_size);
+    g.setQueueSize(1); // only the latest spectrum is drawn
+    g.setWindowFunc(window_function);
+    g.setNormalizeMode(parser.has("exact") ? a2i::EXACT : a2i::FAST);
+    g.setBinAggregation(aggregation);
+
+    // what drawing reads: rate, dB and frequency range, bins and aggregation
+    layout.setAudioInfo(sample_rate, amp);
+    layout.setFreqRange({20, 20000});
+    layout.setFrameSize(FRAME_SIZE);
+    layout.setBinAggregation(aggregation);
+  };
+
+  // g keeps the layout used for drawing, mc does the analysis
+  auto setupMultiChannel = [&](unsigned int sample_rate, unsigned int channels, int mode)
+  {
+    setupSpectrogram(sample_rate);
+    mc.setAudioInfo(sample_rate, amp);
+    mc.setPlannerFlag(planner_flags[planner]);
+    mc.setWindowFunc(window_function);
+    mc.setFrameSize(FRAME_SIZE);
+    mc.setChannels(channels, mode);
+    if(bool_overlap) mc.setOverlap(overlap);
+    else mc.setHopSize(hop_size);
+    mc.setQueueSize(1);
+    mc.setNormalizeMode(parser.has("exact") ? a2i::EXACT : a2i::FAST);
+    MULTI_CHANNEL = true;
+  };
+
+  auto bool_filterbank = parser.has("fb");
+  auto filterbank = parser.get<int>("fb");
+  auto bands = parser.get<int>("bands");
+  if(bool_filterbank && (filterbank < 0 || filterbank > 3))
+  {
+    std::cout << "Invalid -fb option" << '\n';
+    std::cout << "Should be in range (0-3)" << '\n';
+    return 0;
+  }
+  if(bands <= 0)
+  {
+    std::cout << "Invalid -bands option" << '\n';
+    std::cout << "Should be > 0" << '\n';
+    return 0;
+  }
+
+  auto features_path = parser.get<std::string>("features");
+
+  auto stft_path = parser.get<std::string>("stft");
+  auto stft_format = parser.get<int>("stft_format");
+  if(stft_format < 0 || stft_format > 2)
+  {
+    std::cout << "Invalid -stft_format option" << '\n';
+    std::cout << "Should be in range (0-2)" << '\n';
+    return 0;
+  }
+
+  auto pcm_name = parser.get<std::string>("pcm");
+  auto use_pcm = !pcm_name.empty();
+  auto pcm_format = a2i::PcmReader::parseFormat(pcm_name);
+  auto pcm_rate = parser.get<int>("rate");
+  auto pcm_channels = parser.get<int>("channels");
+  if(use_pcm && pcm_format < 0)
+  {
+    std::cout << "Invalid -pcm option" << '\n';
+    std::cout << "Should be s16 or f32" << '\n';
+    return 0;
+  }
+  if(use_pcm && pcm_rate <= 0)
+  {
+    std::cout << "Invalid -rate option" << '\n';
+    std::cout << "Should be > 0" << '\n';
+    return 0;
+  }
+  if(use_pcm && pcm_channels <= 0)
+  {
+    std::cout << "Invalid -channels option" << '\n';
+    std::cout << "Should be > 0" << '\n';
+    return 0;
+  }
+  if(use_pcm && use_mic)
+  {
+    std::cout << "Error: -pcm and -mic can't be used together" << '\n';
+    return 0;
+  }
+
+  auto use_channels = parser.has("channel_mode");
+  auto channel_mode = parser.get<int>("channel_mode");
+  if(use_channels && (channel_mode < 0 || channel_mode > 2))
+  {
+    std::cout << "Invalid -channel_mode option" << '\n';
+    std::cout << "Should be in range (0-2)" << '\n';
+    return 0;
+  }
+  auto pyramid_path = parser.get<std::string>("pyramid");
+  auto pooling = parser.get<int>("pool");
+  if(pooling < 0 || pooling > 1)
+  {
+    std::cout << "Invalid -pool option" << '\n';
+    std::cout << "Should be in range (0-1)" << '\n';
+    return 0;
+  }
+
+  if(use_channels && (bool_filterbank || !stft_path.empty() || !features_path.empty() || !pyramid_path.empty()))
+  {
+    std::cout << "Error: -channel_mode only draws, it can't be used with -fb, --stft, --features or --pyramid" << '\n';
+    return 0;
+  }
+
+  a2i::RenderStyle style;
+  style.line_type = line_type;
+  style.graph_mode = graph_mode;
+  style.fill_type = fill_type;
+  style.border_line = border_line;
+  style.line_color = line_color;
+  style.underline_color = underline_color;
+  style.gradient_coefficient = grad_coefficient;
+  style.colormap = grad ? colormap : -1;
+
+  auto setupViews = [&](StackedViews& views)
+  {
+    for(auto& render : views.renders)
+    {
+      render->setStyle(style);
+      render->setGrid(grid_enabled, grid_line_color, grid_text_color);
+      render->setTrail(bool_num_frames ? num_frames : 0);
+    }
+
+    for(auto& waterfall : views.waterfalls)
+    {
+      waterfall->setGraphMode(graph_mode);
+      waterfall->setColormap(grad ? colormap : -1);
+      waterfall->setGrid(grid_enabled, grid_line_color);
+    }
+  };
+
+  if(!view_path.empty())
+  {
+#ifdef A2I_HEADLESS
+    std::cout << "a2i was built with A2I_HEADLESS, --view needs a window" << '\n';
+#else
+    a2i::PyramidReader pyramid;
+    if(!pyramid.open(view_path))
+    {
+      std::cout << "Error: Can't read a pyramid from " << view_path << '\n';
+      return 0;
+    }
+
+    // the pyramid decides the layout, -a and -f do not apply
+    const auto& header = pyramid.header();
+    g.setAudioInfo(header.sample_rate, {header.db_min, header.db_max});
+    g.setFreqRange({20, 20000});
+    g.setFrameSize(header.frame_size);
+    g.setBinAggregation(aggregation);
+
+    viewPyramid(pyramid, graph_mode, grad ? colormap : -1);
+#endif
+    return 0;
+  }
+
+  auto render_path = parser.get<std::string>("render");
+  if(!render_path.empty() && use_pcm)
+  {
+    std::cout << "Error: --render needs a whole file, use --headless with -pcm" << '\n';
+    return 0;
+  }
+  if(!render_path.empty() && use_channels)
+  {
+    std::cout << "Error: -channel_mode works with the live view and --headless" << '\n';
+    return 0;
+  }
+  if(!render_path.empty())
+  {
+    std::vector<float> samples;
+    unsigned int sample_rate;
+
+    if(!loadMono(file_path, samples, sample_rate))
+    {
+      std::cout << "Error: Can't decode " << file << '\n';
+      return 0;
+    }
+
+    setupSpectrogram(sample_rate);
+
+    auto threads = parser.get<int>("threads");
+    if(threads < 0)
+    {
+      std::cout << "Invalid -threads option" << '\n';
+      std::cout << "Should be >= 0" << '\n';
+      return 0;
+    }
+
+    if(bool_filterbank) g.setFilterbank(filterbank, bands);
+    g.setFeatures(!features_path.empty());
+
+    a2i::Stft stft(g, threads);
+
+    size_t columns = stft.frames(samples.size());
+    if(columns == 0)
+    {
+      std::cout << "Error: File is shorter than one frame" << '\n';
+      return 0;
+    }
+
+    a2i::StftWriter writer;
+    if(!stft_path.empty() && !writer.open(stft_path, a2i::makeStftHeader(g, stft_format)))
+    {
+      std::cout << "Error: Can't write " << stft_path << '\n';
+      return 0;
+    }
+
+    std::vector<a2i::Features> features(features_path.empty() ? 0 : columns);
+
+    // one column per frame, time on x and frequency on y
+    cv::Mat heatmap(WINDOW_HEIGHT, columns, CV_8UC1);
+    stft.run(samples.data(), samples.size(), [&](size_t x, a2i::Spectrogram& worker)
+    {
+      if(bool_filterbank)
+      {
+        drawBands(heatmap, x, worker.bands, worker.getDbRange());
+      }
+      else
+      {
+        worker.drawColumn(heatmap, x, worker.out, graph_mode);
+      }
+
+      const auto& values = bool_filterbank ? worker.bands : worker.out;
+      if(!stft_path.empty()) writer.write(x, values.data());
+      if(!features.empty()) features[x] = worker.features;
+    }, multiplier);
+
+    writer.close();
+
+    if(!features_path.empty())
+    {
+      std::ofstream csv(features_path);
+      csv << "time,rms,peak,centroid,rolloff,flatness,flux,peak_frequency,peak_db\n";
+
+      for(size_t x = 0; x < features.size(); ++x)
+      {
+        const auto& f = features[x];
+        csv << static_cast<double>(x) * g.getHopSize() / sample_rate << ','
+            << f.rms << ',' << f.peak << ',' << f.centroid << ',' << f.rolloff << ','
+            << f.flatness << ',' << f.flux << ','
+            << (f.peak_count ? f.peaks[0].frequency : 0) << ','
+            << (f.peak_count ? f.peaks[0].db : 0) << '\n';
+      }
+
+      if(!csv)
+      {
+        std::cout << "Error: Can't write " << features_path << '\n';
+      }
+    }
+
+    if(grad) cv::applyColorMap(heatmap, heatmap, colormap);
+
+    if(!cv::imwrite(render_path, heatmap))
+    {
+      std::cout << "Error: Can't write " << render_path << '\n';
+    }
+
+    if(!stats_file.empty()) dumpStats(stats_file);
+    if(!wisdom.empty()) a2i::Spectrogram::saveWisdom(wisdom);
+    return 0;
+  }
+
+  auto video_path = parser.get<std::string>("video");
+  auto fps = parser.get<int>("fps");
+  auto fourcc = parser.get<std::string>("fourcc");
+  if(!video_path.empty() && fps <= 0)
+  {
+    std::cout << "Invalid -fps option" << '\n';
+    std::cout << "Should be > 0" << '\n';
+    return 0;
+  }
+  if(!video_path.empty() && fourcc.size() != 4)
+  {
+    std::cout << "Invalid -fourcc option" << '\n';
+    std::cout << "Should be four characters, e.g. mp4v or avc1" << '\n';
+    return 0;
+  }
+
+  // --video runs the same offline pipeline as --headless
+  if(parser.has("headless") || !video_path.empty())
+  {
+    auto frames_path = parser.get<std::string>("frames");
+    const bool raw = frames_path == "-";
+    if(!frames_path.empty() && !raw && !isFramePattern(frames_path))
+    {
+      std::cout << "Invalid --frames option" << '\n';
+      std::cout << "Should be - or a path with one %d, e.g. out/%06d.png" << '\n';
+      return 0;
+    }
+
+    if(frames_path.empty() && stft_path.empty() && video_path.empty() && pyramid_path.empty())
+    {
+      std::cout << "Error: --headless needs --frames, --stft, --video or --pyramid" << '\n';
+      return 0;
+    }
+
+    std::vector<float> samples;
+    unsigned int sample_rate = pcm_rate;
+    unsigned int channels = pcm_channels;
+    a2i::PcmReader reader;
+
+    if(use_pcm)
+    {
+      if(!reader.open(file, pcm_format, pcm_channels))
+      {
+        std::cerr << "Error: Can't open " << file << '\n';
+        return 0;
+      }
+      samples.resize(reader.blockFrames() * (use_channels ? channels : 1));
+    }
+    else if(use_channels ? 
+      !loadInterleaved(file_path, samples, sample_rate, channels) 
+    : !loadMono(file_path, samples, sample_rate))
+    {
+      std::cerr << "Error: Can't decode " << file << '\n';
+      return 0;
+    }
+
+    // samples holds interleaved frames for -channel_mode, mono otherwise
+    const unsigned int stride = use_channels ? channels : 1;
+
+    if(use_channels)
+    {
+      setupMultiChannel(sample_rate, channels, channel_mode);
+      mc.setQueueSize(0);
+    }
+    else
+    {
+      setupSpectrogram(sample_rate);
+    }
+    g.setQueueSize(0);
+
+    // one frame per video frame, the writer gets the exact rate of the integer hop
+    if(!video_path.empty())
+    {
+      unsigned int video_hop = std::max(1l, std::lround(static_cast<double>(sample_rate) / fps));
+      g.setHopSize(video_hop);
+      if(use_channels) mc.setHopSize(video_hop);
+    }
+    if(bool_filterbank) g.setFilterbank(filterbank, bands);
+
+    a2i::StftWriter writer;
+    if(!stft_path.empty() && !writer.open(stft_path, a2i::makeStftHeader(g, stft_format)))
+    {
+      std::cerr << "Error: Can't write " << stft_path << '\n';
+      return 0;
+    }
+
+    a2i::PyramidWriter pyramid;
+    if(!pyramid_path.empty() && !pyramid.open(pyramid_path, a2i::makeStftHeader(g, a2i::UINT8), pooling))
+    {
+      std::cerr << "Error: Can't write " << pyramid_path << '\n';
+      return 0;
+    }
+
+    StackedViews views(use_channels ? mc.outputs() : 1, WINDOW_HEIGHT, WINDOW_WIDTH, waterfall_enabled);
+    setupViews(views);
+
+#ifdef _WIN32
+    if(raw) _setmode(_fileno(stdout), _O_BINARY);
+#endif
+
+    cv::Mat rgb;
+    std::vector<char> name(frames_path.size() + 32);
+    const unsigned int hop = g.getHopSize();
+    size_t index = 0;
+
+    // rendering and encoding overlap, frames cycle between the two queues
+    // so the encoder never holds more than video_frames copies
+    constexpr size_t video_frames = 8;
+    cv::VideoWriter video;
+    a2i::BoundedQueue<cv::Mat> encode_queue(video_frames);
+    a2i::BoundedQueue<cv::Mat> free_frames(video_frames);
+    std::thread encoder;
+
+    if(!video_path.empty())
+    {
+      const double video_fps = static_cast<double>(sample_rate) / hop;
+      if(!video.open(video_path, cv::VideoWriter::fourcc(fourcc[0], fourcc[1], fourcc[2], fourcc[3]), video_fps, views.size()))
+      {
+        std::cerr << "Error: Can't write " << video_path << " with " << fourcc << '\n';
+        return 0;
+      }
+
+      if(DEBUG_MODE) std::cerr << "video: " << video_fps << " fps, hop " << hop << '\n';
+
+      for(size_t i = 0; i < video_frames; ++i) free_frames.push(cv::Mat());
+
+      encoder = std::thread([&]
+      {
+        cv::Mat frame;
+        while(encode_queue.pop(frame))
+        {
+          video.write(frame);
+          free_frames.push(std::move(frame));
+        }
+      });
+    }
+
+    auto emit = [&]()
+    {
+      if(!stft_path.empty()) writer.append(bool_filterbank ? g.bands.data() : g.out.data());
+      if(!pyramid_path.empty()) pyramid.append(bool_filterbank ? g.bands.data() : g.out.data());
+
+      if(!frames_path.empty() || !video_path.empty())
+      {
+        const cv::Mat& frame = use_channels ? views.render(mc.out) : views.render(g.out);
+
+        if(!video_path.empty())
+        {
+          cv::Mat slot;
+          free_frames.pop(slot);
+          frame.copyTo(slot);
+          encode_queue.push(std::move(slot));
+        }
+
+        if(raw)
+        {
+          cv::cvtColor(frame, rgb, cv::COLOR_BGR2RGB);
+          for(int y = 0; y < rgb.rows; ++y)
+          {
+            fwrite(rgb.ptr<uchar>(y), 1, rgb.cols * 3, stdout);
+          }
+        }
+        else if(!frames_path.empty())
+        {
+          snprintf(name.data(), name.size(), frames_path.c_str(), static_cast<int>(index));
+          if(!cv::imwrite(name.data(), frame))
+          {
+            std::cerr << "Error: Can't write " << name.data() << '\n';
+            return false;
+          }
+        }
+      }
+
+      ++index;
+      return true;
+    };
+
+    // pushing at most one hop at a time yields at most one frame per process()
+    auto feed = [&](const float* data, size_t n)
+    {
+      for(size_t pos = 0; pos < n; pos += hop)
+      {
+        size_t count = std::min<size_t>(hop, n - pos);
+        size_t produced;
+
+        if(use_channels)
+        {
+          mc.push(data + pos * stride, count);
+          produced = mc.process(multiplier);
+        }
+        else
+        {
+          g.push(data + pos, count);
+          produced = g.process(multiplier);
+        }
+
+        if(produced > 0 && !emit()) return false;
+      }
+      return true;
+    };
+
+    // video frame k ends at (k + 1) * hop, the end of its time slot: the
+    // analysis is primed with frame_size - hop zeros (or skips that many
+    // samples when the hop is longer than a frame) and the tail is padded to
+    // a whole hop, so there are ceil(duration * fps) frames
+    const bool anchored = !video_path.empty();
+    const unsigned int frame_size = use_channels ? mc.getFrameSize() : g.getFrameSize();
+    size_t skip = anchored && hop > frame_size ? hop - frame_size : 0;
+    uint64_t fed = 0;
+    std::vector<float> zeros;
+
+    auto feedAudio = [&](const float* data, size_t n)
+    {
+      const size_t skipped = std::min(skip, n);
+      skip -= skipped;
+      fed += n;
+      return feed(data + skipped * stride, n - skipped);
+    };
+
+    bool ok = true;
+
+    if(anchored && frame_size > hop)
+    {
+      zeros.assign(static_cast<size_t>(frame_size - hop) * stride, 0.0f);
+      ok = feed(zeros.data(), frame_size - hop);
+    }
+
+    if(use_pcm)
+    {
+      // one block in memory at a time, the stream may never end
+      size_t n;
+      while(ok && (n = use_channels ? reader.readInterleaved(samples.data()) : reader.read(samples.data())) > 0)
+      {
+        ok = feedAudio(samples.data(), n);
+
+        // keep followers of a live stream current
+        if(!stft_path.empty()) writer.flush();
+        if(!pyramid_path.empty()) pyramid.flush();
+        if(raw) fflush(stdout);
+      }
+    }
+    else
+    {
+      ok = feedAudio(samples.data(), samples.size() / stride);
+    }
+
+    if(ok && anchored && fed % hop)
+    {
+      const size_t tail = hop - fed % hop;
+      zeros.assign(tail * stride, 0.0f);
+      ok = feed(zeros.data(), tail);
+    }
+
+    if(encoder.joinable())
+    {
+      encode_queue.close();
+      encoder.join();
+      video.release();
+    }
+
+    if(!ok) return 0;
+
+    if(raw) fflush(stdout);
+    writer.close();
+    pyramid.close();
+
+    if(!stats_file.empty()) dumpStats(stats_file);
+    if(!wisdom.empty()) a2i::Spectrogram::saveWisdom(wisdom);
+    return 0;
+  }
+
+#ifdef A2I_HEADLESS
+  (void)use_mic;
+  (void)volume;
+  std::cout << "a2i was built with A2I_HEADLESS, use --headless, --video or --render" << '\n';
+  return 0;
+#else
   bool stop = true;
 
-  InitAudioDevice();
   AudioStream stream;
   Music music;
+  a2i::PcmReader reader;
 
-  if(use_mic) 
+  if(use_pcm)
+  {
+    if(!reader.open(file, pcm_format, pcm_channels))
+    {
+      std::cout << "Error: Can't open " << file << '\n';
+      return 0;
+    }
+  }
+  else if(use_mic) 
   {
+    InitAudioDevice();
     stream = LoadAudioStream(44100, 16, 1);
     PlayAudioStream(stream);
   } 
   else 
   {
+    InitAudioDevice();
     music = LoadMusicStream(file_path);
     PlayMusicStream(music);
     SetMusicVolume(music, volume);
-    AttachAudioStreamProcessor(music.stream, callback);
   }
 
-  g.setAudioInfo(music.stream.sampleRate, amp);
-  g.setFreqRange({20, 20000});
-  g.setFrameSize(FRAME_SIZE);
-  g.setWindowFunc(window_function);
+  const unsigned int sample_rate = use_pcm ? pcm_rate : use_mic ? stream.sampleRate : music.stream.sampleRate;
+  if(use_channels) setupMultiChannel(sample_rate, use_pcm ? pcm_channels : CALLBACK_CHANNELS, channel_mode);
+  else setupSpectrogram(sample_rate);
+
+  const size_t outputs = use_channels ? mc.outputs() : 1;
+
+  // audio callback -> ring buffer -> dsp thread -> triple buffer -> render loop
+  a2i::TripleBuffer<std::vector<a2i::Spectrum>> spectra(std::vector<a2i::Spectrum>(outputs, a2i::Spectrum(FRAME_SIZE / 2)));
+  std::jthread dsp([&](std::stop_token token)
+  {
+    while(!token.stop_requested())
+    {
+      bool ready = use_channels ? 
+        mc.process(multiplier) > 0 && mc.popSpectra(spectra.back()) 
+      : g.process(multiplier) > 0 && g.popSpectrum(spectra.back()[0]);
+
+      if(ready)
+      {
+        if(spectra.publish()) A2I_PROFILE_COUNT(a2i::COUNTER_LATE, 1);
+      }
+      else
+      {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+      }
+    }
+  });
+
+  // raw pcm stands in for the audio callback, paced to real time so piped files play at normal speed
+  std::jthread pcm_feed;
+  if(use_pcm)
+  {
+    pcm_feed = std::jthread([&](std::stop_token token)
+    {
+      std::vector<float> block(reader.blockFrames() * (use_channels ? pcm_channels : 1));
+      const auto start = std::chrono::steady_clock::now();
+
+      while(!token.stop_requested() && !reader.eof())
+      {
+        if(use_channels)
+        {
+          mc.push(block.data(), reader.readInterleaved(block.data(), 100));
+        }
+        else
+        {
+          size_t n = reader.read(block.data(), 100);
+          for(size_t i = 0; i < n; i += 1024)
+          {
+            g.push(block.data() + i, std::min<size_t>(1024, n - i));
+          }
+        }
+
+        std::this_thread::sleep_until(start + std::chrono::microseconds(reader.frames() * 1000000 / pcm_rate));
+      }
+    });
+  }
+  else if(!use_mic)
+  {
+    AttachAudioStreamProcessor(music.stream, callback);
+  }
 
   cv::namedWindow("a2i", cv::WINDOW_NORMAL);
   cv::resizeWindow("a2i", WINDOW_WIDTH, WINDOW_HEIGHT);
 
-  cv::Mat img(WINDOW_HEIGHT, WINDOW_WIDTH, CV_8UC3, cv::Scalar(22, 16, 20));
-  if(!bool_num_frames) num_frames = 1;
-  std::vector<cv::Mat> prev_frames(num_frames, cv::Mat::zeros(WINDOW_HEIGHT, WINDOW_WIDTH, CV_8UC3));
+  StackedViews views(outputs, WINDOW_HEIGHT, WINDOW_WIDTH, waterfall_enabled);
+  setupViews(views);
+
+  std::vector<float> mic_buffer(use_mic ? FRAME_SIZE * CALLBACK_CHANNELS : 0);
 
-  cv::Mat cur_img = cv::Mat::zeros(WINDOW_HEIGHT, WINDOW_WIDTH, CV_8UC3);
-  cv::Mat grid = cv::Mat::zeros(WINDOW_HEIGHT, WINDOW_WIDTH, CV_8UC3);
-  if(grid_enabled) g.drawGrid(grid, graph_mode, 1, {20, 50, 100, 200, 500, 1000, 2000, 5000, 10000, 20000}, 10, grid_line_color, grid_text_color);
+  cv::Mat stats_frame;
+  auto next_dump = std::chrono::steady_clock::now() + std::chrono::seconds(1);
 
   while(true)
   {
     if(use_mic) 
     {
-      unsigned int frames = FRAME_SIZE;
-      Frame *buffer = (Frame *)malloc(frames * sizeof(Frame));
       if(IsAudioStreamProcessed(stream))
       {
-        UpdateAudioStream(stream, buffer, frames);
-        callback(buffer, frames);
+        UpdateAudioStream(stream, mic_buffer.data(), FRAME_SIZE);
+        callback(mic_buffer.data(), FRAME_SIZE);
       }
-      free(buffer);
     } 
+    else if(use_pcm)
+    {
+      if(cv::getWindowProperty("a2i", cv::WND_PROP_AUTOSIZE) == 1 || cv::waitKey(1) == 27)
+      {
+        break;
+      }
+    }
     else
     {
       UpdateMusicStream(music);
@@ -365,50 +1429,56 @@ int main(int argc, char** argv)
       }
     }
 
-    if(show)
+    if(spectra.update())
     {
-      img = cv::Mat(WINDOW_HEIGHT, WINDOW_WIDTH, CV_8UC3, cv::Scalar(22, 16, 20));
-      if(grid_enabled) cv::add(grid, img, img);
-      cur_img = cv::Mat::zeros(WINDOW_HEIGHT, WINDOW_WIDTH, CV_8UC3);
+      const cv::Mat& frame = views.render(spectra.front());
 
-      g.drawSpectrum(cur_img, line_type, graph_mode, fill_type, border_line, line_color, underline_color, grad_coefficient);
-
-      if(bool_num_frames)
+      if(stats_enabled)
       {
-        for(int i = num_frames - 1; i >= 0; --i)
-        {
-          cv::addWeighted(img, 1.0, prev_frames[i], 0.3 / (i+1), 0.0, img);
-        }
+        frame.copyTo(stats_frame);
+        drawStats(stats_frame);
       }
-      
-      cv::add(cur_img, img, img);
-      if(grad) cv::applyColorMap(img, img, colormap);
-      
-      cv::imshow("a2i", img);
 
-      if(bool_num_frames)
-      {
-        for(int i = num_frames - 1; i > 0; --i)
-        {
-          prev_frames[i] = prev_frames[i - 1].clone();
-        }
+      A2I_PROFILE_SCOPE(a2i::STAGE_SHOW);
+      cv::imshow("a2i", stats_enabled ? stats_frame : frame);
+    }
 
-        cur_img.copyTo(prev_frames[0]);
-      }
+    if(!stats_file.empty() && std::chrono::steady_clock::now() >= next_dump)
+    {
+      dumpStats(stats_file);
+      next_dump += std::chrono::seconds(1);
     }
   }
 
+  if(!stats_file.empty()) dumpStats(stats_file);
+
+  if(use_pcm)
+  {
+    pcm_feed.request_stop();
+    pcm_feed.join();
+  }
+  else if(!use_mic)
+  {
+    DetachAudioStreamProcessor(music.stream, callback);
+  }
+  dsp.request_stop();
+  dsp.join();
+
   if(use_mic) 
   {
     StopAudioStream(stream);
     UnloadAudioStream(stream);
+    CloseAudioDevice();
   } 
-  else 
+  else if(!use_pcm)
   {
     UnloadMusicStream(music);
+    CloseAudioDevice();
   }
-  CloseAudioDevice();
+
+  if(!wisdom.empty()) a2i::Spectrogram::saveWisdom(wisdom);
 
   cv::destroyAllWindows();
   return 0;
+#endif
 }
\ No newline at end of file